@@ -0,0 +1,53 @@
+#pragma once
+
+/* Helpers shared by the benchmarks. Include before any system header. */
+#define _POSIX_C_SOURCE 200112L
+
+#include "ccore.h"
+#include <stdlib.h>
+#include <time.h>
+
+CCORE_INLINE uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+CCORE_INLINE void*
+malloc_alloc(size_t size, void* context)
+{
+    (void)context;
+    return malloc(size);
+}
+
+CCORE_INLINE void
+malloc_free(void* ptr, size_t size, void* context)
+{
+    (void)size;
+    (void)context;
+    free(ptr);
+}
+
+CCORE_INLINE uint64_t
+xorshift(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Hashmap callbacks for u64 keys. */
+CCORE_INLINE uint64_t
+key_hash(const void* key)
+{
+    return u64_hash(*(const u64*)key);
+}
+
+CCORE_INLINE bool
+key_equal(const void* first, const void* second)
+{
+    return *(const u64*)first == *(const u64*)second;
+}
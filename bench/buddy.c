@@ -0,0 +1,84 @@
+#include "bench.h"
+#include <stdio.h>
+
+#define HEAP_SIZE (256 * MEGABYTE)
+#define LIVE_COUNT 8192
+#define OPERATIONS 1000000
+
+typedef struct
+{
+    uint64_t total;
+    uint64_t worst;
+    size_t count;
+} Latency;
+
+static void
+latency_add(Latency* latency, uint64_t elapsed)
+{
+    latency->total += elapsed;
+    latency->count++;
+    if (elapsed > latency->worst) {
+        latency->worst = elapsed;
+    }
+}
+
+static void
+latency_print(const char* name, const Latency* latency)
+{
+    printf("%-6s ops: %8zu  mean: %6.1f ns  worst: %8llu ns\n",
+           name,
+           latency->count,
+           latency->count ? (double)latency->total / latency->count : 0.0,
+           (unsigned long long)latency->worst);
+}
+
+/* Random alloc/free churn over a large heap with thousands of live blocks,
+ * reporting mean and worst-case latency per operation. */
+int
+main(void)
+{
+    void* data = NULL;
+    void** live;
+    BuddyAllocator buddy;
+    Latency alloc_latency = { 0 };
+    Latency free_latency  = { 0 };
+    size_t failed         = 0;
+    size_t i;
+
+    if (posix_memalign(&data, 64, HEAP_SIZE) != 0) {
+        fprintf(stderr, "Could not allocate the benchmark heap.\n");
+        return 1;
+    }
+    live = calloc(LIVE_COUNT, sizeof(void*));
+    buddy_allocator_init(&buddy, data, HEAP_SIZE, DEFAULT_ALIGNMENT);
+    srand(42);
+
+    for (i = 0; i < OPERATIONS; i++) {
+        size_t slot = (size_t)rand() % LIVE_COUNT;
+        uint64_t start;
+
+        if (live[slot] != NULL) {
+            start = now_ns();
+            buddy_allocator_free(&buddy, live[slot]);
+            latency_add(&free_latency, now_ns() - start);
+            live[slot] = NULL;
+        } else {
+            size_t size = 16 + (size_t)rand() % (16 * KILOBYTE);
+            start       = now_ns();
+            live[slot]  = buddy_allocator_alloc(&buddy, size);
+            latency_add(&alloc_latency, now_ns() - start);
+            failed += live[slot] == NULL;
+        }
+    }
+
+    printf("----BUDDY LATENCY (%llu MB heap, %d live slots)----\n",
+           (unsigned long long)(HEAP_SIZE / MEGABYTE),
+           LIVE_COUNT);
+    latency_print("alloc", &alloc_latency);
+    latency_print("free", &free_latency);
+    printf("failed allocations: %zu\n", failed);
+
+    free(live);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "bench.h"
+#include <pthread.h>
+#include <stdio.h>
+
+#define KEY_COUNT (1 << 20)
+#define OPERATIONS 1000000
+#define MAX_THREADS 64
+
+/* Percentage of operations that insert or delete instead of looking up. */
+#define WRITE_PERCENT 10
+
+typedef struct
+{
+    Hashmap map;
+    pthread_rwlock_t lock;
+} LockedHashmap;
+
+typedef struct
+{
+    void* map;
+    bool sharded;
+    uint64_t seed;
+} Worker;
+
+static u64 keys[KEY_COUNT];
+
+static void*
+worker_run(void* arg)
+{
+    Worker* worker = arg;
+    uint64_t state = worker->seed;
+    size_t i;
+
+    for (i = 0; i < OPERATIONS; i++) {
+        uint64_t r = xorshift(&state);
+        u64* key   = &keys[(r >> 8) & (KEY_COUNT - 1)];
+        size_t op  = (size_t)(r & 0xFF) % 100;
+
+        if (worker->sharded) {
+            ConcurrentHashmap* map = worker->map;
+            if (op >= WRITE_PERCENT) {
+                concurrent_hashmap_get(map, key);
+            } else if (op % 2 == 0) {
+                concurrent_hashmap_insert(map, key, key);
+            } else {
+                concurrent_hashmap_delete(map, key);
+            }
+        } else {
+            LockedHashmap* locked = worker->map;
+            if (op >= WRITE_PERCENT) {
+                pthread_rwlock_rdlock(&locked->lock);
+                hashmap_get(&locked->map, key);
+            } else {
+                pthread_rwlock_wrlock(&locked->lock);
+                if (op % 2 == 0) {
+                    hashmap_insert(&locked->map, key, key);
+                } else {
+                    hashmap_delete(&locked->map, key);
+                }
+            }
+            pthread_rwlock_unlock(&locked->lock);
+        }
+    }
+    return NULL;
+}
+
+/* Returns millions of operations per second. */
+static double
+run(void* map, bool sharded, size_t thread_count)
+{
+    pthread_t threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    uint64_t start, elapsed;
+    size_t i;
+
+    for (i = 0; i < thread_count; i++) {
+        workers[i].map     = map;
+        workers[i].sharded = sharded;
+        workers[i].seed    = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+
+    start = now_ns();
+    for (i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = now_ns() - start;
+
+    return (double)thread_count * OPERATIONS * 1000.0 / elapsed;
+}
+
+int
+main(int argc, char** argv)
+{
+    size_t max_threads  = argc > 1 ? (size_t)atoi(argv[1]) : MAX_THREADS;
+    Allocator allocator = { .alloc = malloc_alloc, .free = malloc_free };
+    size_t threads, i;
+
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+    for (i = 0; i < KEY_COUNT; i++) {
+        keys[i] = i;
+    }
+
+    printf("----HASHMAP THROUGHPUT, %d%% WRITES (Mops/s)----\n",
+           WRITE_PERCENT);
+    printf("%8s %12s %12s\n", "threads", "rwlock", "sharded");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        LockedHashmap locked;
+        ConcurrentHashmap sharded;
+        double locked_rate, sharded_rate;
+
+        hashmap_init(&locked.map, key_hash, key_equal, KEY_COUNT, &allocator);
+        pthread_rwlock_init(&locked.lock, NULL);
+        concurrent_hashmap_init(
+          &sharded, key_hash, key_equal, KEY_COUNT, &allocator);
+        for (i = 0; i < KEY_COUNT; i += 2) {
+            hashmap_insert(&locked.map, &keys[i], &keys[i]);
+            concurrent_hashmap_insert(&sharded, &keys[i], &keys[i]);
+        }
+
+        locked_rate  = run(&locked, false, threads);
+        sharded_rate = run(&sharded, true, threads);
+        printf("%8zu %12.2f %12.2f\n", threads, locked_rate, sharded_rate);
+
+        pthread_rwlock_destroy(&locked.lock);
+        hashmap_destroy(&locked.map);
+        concurrent_hashmap_destroy(&sharded);
+    }
+
+    return 0;
+}
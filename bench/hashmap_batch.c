@@ -0,0 +1,89 @@
+#include "bench.h"
+#include <stdio.h>
+
+#define KEY_COUNT (1 << 21)
+#define REQUEST_KEYS 32
+#define REQUESTS 200000
+
+int
+main(void)
+{
+    Allocator allocator = { .alloc = malloc_alloc, .free = malloc_free };
+    u64* keys           = malloc(sizeof(u64) * KEY_COUNT);
+    void** order        = malloc(sizeof(void*) * KEY_COUNT);
+    void** requests     = malloc(sizeof(void*) * REQUESTS * REQUEST_KEYS);
+    void* values[REQUEST_KEYS];
+    Hashmap map;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint64_t start, insert_ns, batch_insert_ns, get_ns, batch_get_ns;
+    size_t i, j, found = 0;
+
+    /* Keys are inserted in shuffled order and looked up at random. */
+    for (i = 0; i < KEY_COUNT; i++) {
+        keys[i]  = i;
+        order[i] = &keys[i];
+    }
+    for (i = KEY_COUNT - 1; i > 0; i--) {
+        size_t other = xorshift(&state) % (i + 1);
+        void* key    = order[i];
+        order[i]     = order[other];
+        order[other] = key;
+    }
+    for (i = 0; i < REQUESTS * REQUEST_KEYS; i++) {
+        requests[i] = &keys[xorshift(&state) & (KEY_COUNT - 1)];
+    }
+
+    hashmap_init(&map, key_hash, key_equal, 2 * KEY_COUNT, &allocator);
+    start = now_ns();
+    for (i = 0; i < KEY_COUNT; i++) {
+        hashmap_insert(&map, order[i], order[i]);
+    }
+    insert_ns = now_ns() - start;
+    hashmap_destroy(&map);
+
+    hashmap_init(&map, key_hash, key_equal, 2 * KEY_COUNT, &allocator);
+    start = now_ns();
+    for (i = 0; i < KEY_COUNT; i += REQUEST_KEYS) {
+        hashmap_insert_batch(&map, &order[i], &order[i], REQUEST_KEYS);
+    }
+    batch_insert_ns = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < REQUESTS; i++) {
+        for (j = 0; j < REQUEST_KEYS; j++) {
+            found += hashmap_get(&map, requests[i * REQUEST_KEYS + j]) != NULL;
+        }
+    }
+    get_ns = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < REQUESTS; i++) {
+        hashmap_get_batch(
+          &map, &requests[i * REQUEST_KEYS], values, REQUEST_KEYS);
+        for (j = 0; j < REQUEST_KEYS; j++) {
+            found += values[j] != NULL;
+        }
+    }
+    batch_get_ns = now_ns() - start;
+
+    printf("----HASHMAP BATCHES OF %d, %d KEYS (ns/key)----\n",
+           REQUEST_KEYS,
+           KEY_COUNT);
+    printf("%-24s %8.1f\n", "hashmap_insert", (double)insert_ns / KEY_COUNT);
+    printf("%-24s %8.1f\n",
+           "hashmap_insert_batch",
+           (double)batch_insert_ns / KEY_COUNT);
+    printf("%-24s %8.1f\n",
+           "hashmap_get",
+           (double)get_ns / (REQUESTS * REQUEST_KEYS));
+    printf("%-24s %8.1f\n",
+           "hashmap_get_batch",
+           (double)batch_get_ns / (REQUESTS * REQUEST_KEYS));
+    assert(found == 2 * REQUESTS * REQUEST_KEYS);
+
+    hashmap_destroy(&map);
+    free(requests);
+    free(order);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "bench.h"
+#include <pthread.h>
+#include <stdio.h>
+
+#define CHUNK_SIZE 64
+#define BATCH 64
+#define ITERATIONS 20000
+#define MAX_THREADS 64
+
+typedef struct
+{
+    Pool pool;
+    pthread_mutex_t lock;
+} LockedPool;
+
+typedef enum
+{
+    WORKER_MUTEX,
+    WORKER_LOCK_FREE,
+    WORKER_MAGAZINE
+} WorkerKind;
+
+typedef struct
+{
+    void* pool;
+    WorkerKind kind;
+} Worker;
+
+static void*
+worker_run(void* arg)
+{
+    Worker* worker = arg;
+    void* chunks[BATCH];
+
+    PoolCache cache;
+    size_t i, j;
+
+    if (worker->kind == WORKER_MAGAZINE &&
+        pool_cache_init(&cache, worker->pool) != 0) {
+        return NULL;
+    }
+
+    for (i = 0; i < ITERATIONS; i++) {
+        if (worker->kind == WORKER_LOCK_FREE) {
+            ConcurrentPool* pool = worker->pool;
+            for (j = 0; j < BATCH; j++) {
+                chunks[j] = concurrent_pool_allocate(pool);
+            }
+            for (j = 0; j < BATCH; j++) {
+                concurrent_pool_free(pool, chunks[j]);
+            }
+        } else if (worker->kind == WORKER_MAGAZINE) {
+            for (j = 0; j < BATCH; j++) {
+                chunks[j] = pool_cache_allocate(&cache);
+            }
+            for (j = 0; j < BATCH; j++) {
+                pool_cache_free(&cache, chunks[j]);
+            }
+        } else {
+            LockedPool* locked = worker->pool;
+            for (j = 0; j < BATCH; j++) {
+                pthread_mutex_lock(&locked->lock);
+                chunks[j] = pool_allocate(&locked->pool);
+                pthread_mutex_unlock(&locked->lock);
+            }
+            for (j = 0; j < BATCH; j++) {
+                pthread_mutex_lock(&locked->lock);
+                pool_free(&locked->pool, chunks[j]);
+                pthread_mutex_unlock(&locked->lock);
+            }
+        }
+    }
+
+    if (worker->kind == WORKER_MAGAZINE) {
+        pool_cache_flush(&cache);
+    }
+    return NULL;
+}
+
+/* Returns millions of alloc+free pairs per second. */
+static double
+run(void* pool, WorkerKind kind, size_t thread_count)
+{
+    pthread_t threads[MAX_THREADS];
+    Worker worker = { pool, kind };
+    uint64_t start, elapsed;
+    size_t i;
+
+    start = now_ns();
+    for (i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, worker_run, &worker);
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = now_ns() - start;
+
+    return (double)thread_count * ITERATIONS * BATCH * 1000.0 / elapsed;
+}
+
+int
+main(int argc, char** argv)
+{
+    size_t max_threads  = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    size_t size         = 4 * MAX_THREADS * BATCH * CHUNK_SIZE;
+    void* locked_base   = malloc(size);
+    void* atomic_base   = malloc(size);
+    void* cached_base   = malloc(size);
+    Allocator allocator = { .alloc = malloc_alloc, .free = malloc_free };
+    size_t threads;
+
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    printf("----POOL ALLOC/FREE THROUGHPUT (Mops/s)----\n");
+    printf("%8s %12s %12s %12s\n", "threads", "mutex", "lock-free", "magazine");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        LockedPool locked;
+        ConcurrentPool concurrent;
+        Pool cached;
+        PoolDepot depot;
+        double locked_rate, concurrent_rate, cached_rate;
+
+        pool_init(&locked.pool, locked_base, size, CHUNK_SIZE, CHUNK_SIZE);
+        pthread_mutex_init(&locked.lock, NULL);
+        concurrent_pool_init(
+          &concurrent, atomic_base, size, CHUNK_SIZE, CHUNK_SIZE);
+        pool_init(&cached, cached_base, size, CHUNK_SIZE, CHUNK_SIZE);
+        pool_depot_init(&depot, &cached, &allocator);
+
+        locked_rate     = run(&locked, WORKER_MUTEX, threads);
+        concurrent_rate = run(&concurrent, WORKER_LOCK_FREE, threads);
+        cached_rate     = run(&depot, WORKER_MAGAZINE, threads);
+        printf("%8zu %12.2f %12.2f %12.2f\n",
+               threads,
+               locked_rate,
+               concurrent_rate,
+               cached_rate);
+
+        pthread_mutex_destroy(&locked.lock);
+        pool_depot_destroy(&depot);
+    }
+
+    free(locked_base);
+    free(atomic_base);
+    free(cached_base);
+    return 0;
+}
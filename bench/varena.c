@@ -0,0 +1,88 @@
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define RESERVE (4ULL * 1024 * MEGABYTE)
+#define TOTAL (256 * MEGABYTE)
+#define PUSH_SIZE (64 * KILOBYTE)
+
+typedef struct
+{
+    const char* name;
+    unsigned flags;
+} Config;
+
+static long
+minor_faults(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+int
+main(void)
+{
+    Config configs[] = {
+        { "default", 0 },
+        { "geometric", VARENA_GEOMETRIC },
+        { "prefault", VARENA_PREFAULT | VARENA_GEOMETRIC },
+        { "thp", VARENA_HUGE_PAGES | VARENA_GEOMETRIC },
+        { "thp+prefault",
+          VARENA_HUGE_PAGES | VARENA_PREFAULT | VARENA_GEOMETRIC },
+        { "hugetlb", VARENA_HUGETLB | VARENA_GEOMETRIC },
+    };
+    size_t c;
+
+    printf("----VARENA FIRST TOUCH OF %llu MB----\n",
+           (unsigned long long)(TOTAL / MEGABYTE));
+    printf("%-14s %12s %12s %10s %10s\n",
+           "flags",
+           "push faults",
+           "touch faults",
+           "commits",
+           "ms");
+    for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        VArena varena;
+        size_t commits = 0, pages = 0, pushed;
+        long push_faults = 0, touch_faults = 0;
+        uint64_t start;
+
+        if (varena_init_flags(&varena,
+                              RESERVE,
+                              system_page_size(),
+                              DEFAULT_ALIGNMENT,
+                              configs[c].flags) != 0) {
+            printf("%-14s %12s\n", configs[c].name, "failed");
+            continue;
+        }
+
+        start = now_ns();
+        for (pushed = 0; pushed < TOTAL; pushed += PUSH_SIZE) {
+            long before = minor_faults();
+            void* ptr   = varena_push(&varena, PUSH_SIZE);
+            long middle = minor_faults();
+            memset(ptr, 1, PUSH_SIZE);
+            push_faults += middle - before;
+            touch_faults += minor_faults() - middle;
+            if (varena.page_count != pages) {
+                pages = varena.page_count;
+                commits++;
+            }
+        }
+        printf("%-14s %12ld %12ld %10zu %10.1f%s\n",
+               configs[c].name,
+               push_faults,
+               touch_faults,
+               commits,
+               (now_ns() - start) / 1e6,
+               (configs[c].flags & VARENA_HUGETLB) &&
+                   !(varena.flags & VARENA_HUGETLB)
+                 ? " (no hugetlb pool, used thp)"
+                 : "");
+
+        varena_destroy(&varena);
+    }
+    return 0;
+}
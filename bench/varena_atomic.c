@@ -0,0 +1,96 @@
+#include "bench.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RECORD_SIZE 64
+#define RECORDS 200000
+#define MAX_THREADS 64
+#define RESERVE (16ULL * 1024 * MEGABYTE)
+
+typedef struct
+{
+    VArena varena;
+    pthread_mutex_t lock;
+    bool atomic;
+} SharedLog;
+
+static void*
+producer_run(void* arg)
+{
+    SharedLog* log = arg;
+    size_t i;
+
+    for (i = 0; i < RECORDS; i++) {
+        u8* record;
+        if (log->atomic) {
+            record = varena_push_atomic(&log->varena, RECORD_SIZE);
+        } else {
+            pthread_mutex_lock(&log->lock);
+            record = varena_push(&log->varena, RECORD_SIZE);
+            pthread_mutex_unlock(&log->lock);
+        }
+        memset(record, (int)i, RECORD_SIZE);
+    }
+    return NULL;
+}
+
+/* Returns millions of records appended per second. */
+static double
+run(bool atomic, unsigned flags, size_t thread_count)
+{
+    pthread_t threads[MAX_THREADS];
+    SharedLog log;
+    uint64_t start, elapsed;
+    size_t i;
+
+    varena_init_flags(&log.varena,
+                      RESERVE,
+                      system_page_size(),
+                      DEFAULT_ALIGNMENT,
+                      flags);
+    pthread_mutex_init(&log.lock, NULL);
+    log.atomic = atomic;
+
+    start = now_ns();
+    for (i = 0; i < thread_count; i++) {
+        pthread_create(&threads[i], NULL, producer_run, &log);
+    }
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = now_ns() - start;
+
+    pthread_mutex_destroy(&log.lock);
+    varena_destroy(&log.varena);
+    return (double)thread_count * RECORDS * 1000.0 / elapsed;
+}
+
+int
+main(int argc, char** argv)
+{
+    size_t max_threads = argc > 1 ? (size_t)atoi(argv[1]) : 8;
+    size_t threads;
+
+    if (max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    printf("----VARENA %d BYTE APPENDS (Mrecords/s)----\n", RECORD_SIZE);
+    printf("%8s %12s %12s %12s\n",
+           "threads",
+           "mutex",
+           "atomic",
+           "atomic+geo");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        double locked_rate    = run(false, 0, threads);
+        double atomic_rate    = run(true, 0, threads);
+        double geometric_rate = run(true, VARENA_GEOMETRIC, threads);
+        printf("%8zu %12.2f %12.2f %12.2f\n",
+               threads,
+               locked_rate,
+               atomic_rate,
+               geometric_rate);
+    }
+    return 0;
+}
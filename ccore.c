@@ -10,10 +10,15 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <sched.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* CSV Header:
  * Type,Function,BaseAddress,AllocAddress,Size,Used,Committed,Capacity,ExtraInfo
  */
@@ -60,6 +65,101 @@ system_page_size()
 #endif
 }
 
+/* Spins with a pause for a while, then starts yielding so a lock holder
+ * that was preempted gets to run when threads outnumber cores. */
+#define SPIN_YIELD_AFTER 64
+
+static void
+spin_pause(unsigned* spins)
+{
+    if (++*spins < SPIN_YIELD_AFTER) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return;
+    }
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static void
+spin_lock(int* lock)
+{
+    unsigned spins = 0;
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            spin_pause(&spins);
+        }
+    }
+}
+
+static void
+spin_unlock(int* lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Reader-writer spin lock: the low bits count readers and SPIN_WRITER is
+ * set by a writer as soon as it arrives, which keeps new readers out until
+ * it is done so a steady stream of readers cannot starve it. */
+#define SPIN_WRITER (1 << 30)
+
+static void
+spin_read_lock(int* lock)
+{
+    unsigned spins = 0;
+    for (;;) {
+        int state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (!(state & SPIN_WRITER) &&
+            __atomic_compare_exchange_n(lock,
+                                        &state,
+                                        state + 1,
+                                        true,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return;
+        }
+        spin_pause(&spins);
+    }
+}
+
+static void
+spin_read_unlock(int* lock)
+{
+    __atomic_fetch_sub(lock, 1, __ATOMIC_RELEASE);
+}
+
+static void
+spin_write_lock(int* lock)
+{
+    unsigned spins = 0;
+    for (;;) {
+        int state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (!(state & SPIN_WRITER) &&
+            __atomic_compare_exchange_n(lock,
+                                        &state,
+                                        state | SPIN_WRITER,
+                                        true,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            break;
+        }
+        spin_pause(&spins);
+    }
+    while (__atomic_load_n(lock, __ATOMIC_ACQUIRE) != SPIN_WRITER) {
+        spin_pause(&spins);
+    }
+}
+
+static void
+spin_write_unlock(int* lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
 int
 varena_destroy(VArena* varena)
 {
@@ -75,13 +175,122 @@ varena_destroy(VArena* varena)
     return 0;
 }
 
+/* Gives back committed pages above what the decayed high-water mark says
+ * the next cycles will need. */
+static void
+varena_decommit_excess(VArena* varena)
+{
+    size_t committed = varena->page_count * varena->page_size;
+    size_t keep;
+
+    varena->high_water -= varena->high_water >> VARENA_HIGH_WATER_DECAY;
+    if (varena->peak > varena->high_water) {
+        varena->high_water = varena->peak;
+    }
+    varena->peak = 0;
+
+    keep = varena->high_water > varena->retain ? varena->high_water
+                                               : varena->retain;
+    if (keep >= committed || committed - keep <= keep) {
+        return;
+    }
+
+    keep = (keep + varena->page_size - 1) / varena->page_size;
+    vmem_decommit((u8*)varena->base + keep * varena->page_size,
+                  committed - keep * varena->page_size);
+#ifdef CCORE_VERBOSE
+    CSV_LOG_VARENA("DECOMMIT",
+                   (u8*)varena->base + keep * varena->page_size,
+                   committed - keep * varena->page_size,
+                   "Decommitted above high-water mark");
+#endif
+    varena->page_count = keep;
+}
+
 void
 varena_clear(VArena* varena)
 {
+    if (varena->used > varena->peak) {
+        varena->peak = varena->used;
+    }
     varena->used = 0;
 #ifdef CCORE_VERBOSE
     CSV_LOG_VARENA("CLEAR", varena->base, 0, "Pointer Reset");
 #endif
+    varena_decommit_excess(varena);
+}
+
+void
+varena_set_retain(VArena* varena, size_t retain)
+{
+    varena->retain = retain;
+}
+
+size_t
+varena_mark(VArena* varena)
+{
+    return varena->used;
+}
+
+void
+varena_rewind(VArena* varena, size_t mark)
+{
+    assert(mark <= varena->used);
+    if (varena->used > varena->peak) {
+        varena->peak = varena->used;
+    }
+    varena->used = mark;
+#ifdef CCORE_VERBOSE
+    CSV_LOG_VARENA("REWIND", (u8*)varena->base + mark, 0, "Pointer Reset");
+#endif
+}
+
+static CCORE_THREAD_LOCAL VArena scratch_arenas[SCRATCH_ARENA_COUNT];
+
+ScratchArena
+scratch_begin(VArena** conflicts, size_t conflict_count)
+{
+    ScratchArena scratch = { NULL, 0 };
+    size_t i, j;
+
+    for (i = 0; i < SCRATCH_ARENA_COUNT && scratch.arena == NULL; i++) {
+        VArena* candidate = &scratch_arenas[i];
+        bool conflicting  = false;
+        for (j = 0; j < conflict_count; j++) {
+            conflicting |= conflicts[j] == candidate;
+        }
+        if (!conflicting) {
+            scratch.arena = candidate;
+        }
+    }
+
+    assert(scratch.arena != NULL && "every scratch arena is in conflict");
+    if (scratch.arena->base == NULL &&
+        varena_init(scratch.arena, SCRATCH_ARENA_RESERVE) != 0) {
+        scratch.arena = NULL;
+        return scratch;
+    }
+    scratch.mark = varena_mark(scratch.arena);
+    return scratch;
+}
+
+void
+scratch_end(ScratchArena scratch)
+{
+    if (scratch.arena != NULL) {
+        varena_rewind(scratch.arena, scratch.mark);
+    }
+}
+
+void
+scratch_release(void)
+{
+    size_t i;
+    for (i = 0; i < SCRATCH_ARENA_COUNT; i++) {
+        if (scratch_arenas[i].base != NULL) {
+            varena_destroy(&scratch_arenas[i]);
+        }
+    }
 }
 
 int
@@ -92,21 +301,62 @@ varena_init(VArena* arena, size_t size)
 
 int
 varena_init_ex(VArena* varena, size_t size, size_t page_size, size_t alignment)
+{
+    return varena_init_flags(varena, size, page_size, alignment, 0);
+}
+
+static size_t
+round_up(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+int
+varena_init_flags(VArena* varena,
+                  size_t size,
+                  size_t page_size,
+                  size_t alignment,
+                  unsigned flags)
 {
     assert(page_size % system_page_size() == 0);
-    void* base = vmem_reserve(size);
+    void* base = NULL;
 
-    varena->base       = base;
-    varena->used       = 0;
-    varena->page_count = 0;
-    varena->page_size  = page_size;
-    varena->size       = size;
-    varena->alignment  = alignment;
+    if (flags & (VARENA_HUGE_PAGES | VARENA_HUGETLB)) {
+        page_size = round_up(page_size, VARENA_HUGE_PAGE_SIZE);
+        size      = round_up(size, VARENA_HUGE_PAGE_SIZE);
+    }
+    if (flags & VARENA_HUGETLB) {
+        base = vmem_reserve_hugetlb(size);
+        if (base == NULL) {
+            flags = (flags & ~VARENA_HUGETLB) | VARENA_HUGE_PAGES;
+        }
+    }
+    if (base == NULL && (flags & VARENA_HUGE_PAGES)) {
+        base = vmem_reserve_aligned(size, VARENA_HUGE_PAGE_SIZE);
+        if (base != NULL) {
+            vmem_advise_huge(base, size);
+        }
+    }
+    if (base == NULL) {
+        base = vmem_reserve(size);
+    }
+
+    varena->base        = base;
+    varena->used        = 0;
+    varena->page_count  = 0;
+    varena->page_size   = page_size;
+    varena->size        = size;
+    varena->alignment   = alignment;
+    varena->flags       = flags;
+    varena->retain      = VARENA_DEFAULT_RETAIN;
+    varena->high_water  = 0;
+    varena->peak        = 0;
+    varena->commit_lock = 0;
 #ifdef CCORE_VERBOSE
     CSV_LOG_VARENA("INIT", base, size, "Reserved Virtual Space");
 #endif
 
-    return 0;
+    return base == NULL;
 }
 
 static int
@@ -121,13 +371,18 @@ varena_commit_pages(VArena* varena, size_t amount)
     void* start = (uint8_t*)varena->base + committed;
 
     vmem_commit(start, varena->page_size * amount);
+    if (varena->flags & VARENA_PREFAULT) {
+        vmem_prefault(start, varena->page_size * amount, system_page_size());
+    }
 
 #ifdef CCORE_VERBOSE
     char info[64];
     sprintf(info, "Committed %zu new pages", amount);
     CSV_LOG_VARENA("COMMIT", start, varena->page_size * amount, info);
 #endif
-    varena->page_count += amount;
+    /* Published with release so varena_push_atomic can check it unlocked. */
+    __atomic_store_n(
+      &varena->page_count, varena->page_count + amount, __ATOMIC_RELEASE);
     return 0;
 }
 
@@ -142,27 +397,58 @@ align_forward(uintptr_t ptr, size_t alignment)
     return ptr;
 }
 
-static void
-varena_increase_capacity(VArena* varena, size_t size)
+/* Commits enough pages for the first end_offset bytes to be usable. */
+static int
+varena_commit_to(VArena* varena, size_t end_offset)
 {
-    size_t end_offset   = varena->used + size;
     size_t committed    = varena->page_size * varena->page_count;
     size_t bytes_needed = end_offset > committed ? end_offset - committed : 0;
     size_t pages_needed =
       (bytes_needed + varena->page_size - 1) / varena->page_size;
 
-    varena->used += size;
-
     if (pages_needed == 0) {
-        return;
+        return 0;
     }
 
-    int err = varena_commit_pages(varena, pages_needed);
+    if ((varena->flags & VARENA_GEOMETRIC) &&
+        pages_needed < varena->page_count) {
+        size_t available = (varena->size - committed - 1) / varena->page_size;
+        pages_needed     = varena->page_count < available ? varena->page_count
+                                                          : available;
+        if (pages_needed * varena->page_size < bytes_needed) {
+            pages_needed =
+              (bytes_needed + varena->page_size - 1) / varena->page_size;
+        }
+    }
+
+    return varena_commit_pages(varena, pages_needed);
+}
+
+static void
+varena_increase_capacity(VArena* varena, size_t size)
+{
+    int err = varena_commit_to(varena, varena->used + size);
+    varena->used += size;
     if (err != 0) {
         fprintf(stderr, "VArena: Error while committing pages.\n");
     }
 }
 
+/* Whether size more bytes can be pushed without running past the
+ * reservation, which varena_push only reports after the fact. */
+static bool
+varena_fits(VArena* varena, size_t size)
+{
+    size_t start = align_forward(varena->used, varena->alignment);
+    size_t pages;
+
+    if (start > varena->size || size > varena->size - start) {
+        return false;
+    }
+    pages = (start + size + varena->page_size - 1) / varena->page_size;
+    return pages * varena->page_size < varena->size;
+}
+
 void*
 varena_push(VArena* varena, size_t size)
 {
@@ -178,6 +464,32 @@ varena_push(VArena* varena, size_t size)
     return result;
 }
 
+void*
+varena_push_atomic(VArena* varena, size_t size)
+{
+    size_t rounded = (size + varena->alignment - 1) & ~(varena->alignment - 1);
+    size_t start =
+      __atomic_fetch_add(&varena->used, rounded, __ATOMIC_RELAXED);
+    size_t end = start + size;
+
+    assert((start & (varena->alignment - 1)) == 0);
+
+    /* Only one thread commits at a time. Threads that need the same range
+     * wait on the lock and then find it already committed. */
+    if (end > __atomic_load_n(&varena->page_count, __ATOMIC_ACQUIRE) *
+                varena->page_size) {
+        int err;
+        spin_lock(&varena->commit_lock);
+        err = varena_commit_to(varena, end);
+        spin_unlock(&varena->commit_lock);
+        if (err != 0) {
+            return NULL;
+        }
+    }
+
+    return (uint8_t*)varena->base + start;
+}
+
 void
 varena_push_copy(VArena* arena, const void* data, size_t size)
 {
@@ -187,16 +499,24 @@ varena_push_copy(VArena* arena, const void* data, size_t size)
 void
 arena_init_ex(Arena* arena, void* base, size_t size, size_t alignment)
 {
-    arena->base      = base;
-    arena->size      = size;
-    arena->alignment = alignment;
-    arena->used      = 0;
+    arena->base       = base;
+    arena->size       = size;
+    arena->alignment  = alignment;
+    arena->used       = 0;
+    arena->parent     = NULL;
+    arena->first_base = base;
+    arena->first_size = size;
+    arena->blocks     = NULL;
+    arena->current    = NULL;
 }
 
 void
 arena_clear(Arena* arena)
 {
-    arena->used = 0;
+    arena->used    = 0;
+    arena->base    = arena->first_base;
+    arena->size    = arena->first_size;
+    arena->current = NULL;
 #ifdef CCORE_VERBOSE
     /* printf("CCORE: ARENA, %p, CLEAR\n", arena->base); */
 #endif
@@ -208,17 +528,104 @@ arena_init(Arena* arena, void* base, size_t size)
     arena_init_ex(arena, base, size, DEFAULT_ALIGNMENT);
 }
 
+void
+arena_init_chained(Arena* arena, void* base, size_t size, Allocator* parent)
+{
+    arena_init_ex(arena, base, size, DEFAULT_ALIGNMENT);
+    arena->parent = parent;
+}
+
+void
+arena_destroy(Arena* arena)
+{
+    ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+        arena->parent->free(block,
+                            sizeof(ArenaBlock) + block->size,
+                            arena->parent->context);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena_clear(arena);
+}
+
+/* Moves to the block after the current one, reusing it if it can hold
+ * needed bytes and otherwise linking a new block in before it. */
+static bool
+arena_next_block(Arena* arena, size_t needed)
+{
+    ArenaBlock** link =
+      arena->current != NULL ? &arena->current->next : &arena->blocks;
+    ArenaBlock* block = *link;
+
+    if (arena->parent == NULL) {
+        return false;
+    }
+
+    if (block == NULL || block->size < needed) {
+        size_t size = arena->size * 2;
+        if (size < needed) {
+            size = needed;
+        }
+        if (size < ARENA_MIN_BLOCK_SIZE) {
+            size = ARENA_MIN_BLOCK_SIZE;
+        }
+        block = arena->parent->alloc(sizeof(ArenaBlock) + size,
+                                     arena->parent->context);
+        if (block == NULL) {
+            return false;
+        }
+        block->size = size;
+        block->next = *link;
+        *link       = block;
+    }
+
+    arena->current = block;
+    arena->base    = block + 1;
+    arena->size    = block->size;
+    arena->used    = 0;
+    return true;
+}
+
 static void*
 arena_push_aligned(Arena* arena, size_t size, size_t alignment)
 {
-    arena->used = align_forward(arena->used, alignment);
-    arena->used += size;
-    if (arena->used > arena->size) {
-        printf("Arena is full\n");
-        return NULL;
+    size_t start = align_forward(arena->used, alignment);
+
+    if (start + size > arena->size) {
+        if (!arena_next_block(arena, size + alignment)) {
+            printf("Arena is full\n");
+            return NULL;
+        }
+        start = align_forward(arena->used, alignment);
     }
 
-    return arena->base + arena->used - size;
+    arena->used = start + size;
+    return (u8*)arena->base + start;
+}
+
+ArenaMark
+arena_mark(Arena* arena)
+{
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used  = arena->used;
+    return mark;
+}
+
+void
+arena_rewind(Arena* arena, ArenaMark mark)
+{
+    if (mark.block != NULL) {
+        arena->base = mark.block + 1;
+        arena->size = mark.block->size;
+    } else {
+        arena->base = arena->first_base;
+        arena->size = arena->first_size;
+    }
+    arena->current = mark.block;
+    arena->used    = mark.used;
 }
 
 void*
@@ -252,15 +659,15 @@ arena_realloc_(void* start, size_t old_size, size_t new_size, void* context)
 
     /* If at the end of the arena, we can just push
     the required size and return the original pointer. */
-    if (start + old_size == arena->base + arena->used) {
+    if (start + old_size == arena->base + arena->used &&
+        arena->used + new_size - old_size <= arena->size) {
         arena->used += new_size - old_size;
-        if (arena->used > arena->size) {
-            printf("Arena is full\n");
-            return NULL;
-        }
         return start;
     } else {
         void* new_start = arena_allocate(arena, new_size);
+        if (new_start == NULL) {
+            return NULL;
+        }
 #ifdef CCORE_VERBOSE
         printf("Copied %lu bytes from %p to %p.\n", old_size, start, new_start);
 #endif
@@ -313,7 +720,6 @@ pool_alloc_(size_t bytes, void* context)
 {
     assert(bytes <= ((Pool*)context)->chunk_size &&
            "Size was larger than chunk size");
-    printf("Allocating chunk from pool.\n");
     return pool_allocate((Pool*)context);
 }
 
@@ -334,6 +740,95 @@ pool_realloc_(void* start, size_t old_size, size_t new_size, void* context)
     return start;
 }
 
+static void*
+slab_alloc_(size_t bytes, void* context)
+{
+    return slab_allocate((SlabAllocator*)context, bytes);
+}
+
+static void
+slab_free_(void* ptr, size_t bytes, void* context)
+{
+    slab_free((SlabAllocator*)context, ptr, bytes);
+}
+
+static void*
+slab_realloc_(void* start, size_t old_size, size_t new_size, void* context)
+{
+    SlabAllocator* slab = context;
+    void* new_start;
+
+    if (old_size <= SLAB_MAX_SIZE && new_size <= SLAB_MAX_SIZE &&
+        slab->class_of[(old_size + 15) >> 4] ==
+          slab->class_of[(new_size + 15) >> 4]) {
+        return start;
+    }
+    if (old_size > SLAB_MAX_SIZE && new_size > SLAB_MAX_SIZE) {
+        return slab->fallback->realloc(
+          start, old_size, new_size, slab->fallback->context);
+    }
+
+    new_start = slab_allocate(slab, new_size);
+    if (new_start == NULL) {
+        return NULL;
+    }
+    memcpy(new_start, start, old_size < new_size ? old_size : new_size);
+    slab_free(slab, start, old_size);
+    return new_start;
+}
+
+static void*
+pool_cache_alloc_(size_t bytes, void* context)
+{
+    assert(bytes <= ((PoolCache*)context)->depot->pool->chunk_size &&
+           "Size was larger than chunk size");
+    return pool_cache_allocate((PoolCache*)context);
+}
+
+static void
+pool_cache_free_(void* ptr, size_t bytes, void* context)
+{
+    (void)bytes;
+    pool_cache_free((PoolCache*)context, ptr);
+}
+
+static void*
+pool_cache_realloc_(void* start,
+                    size_t old_size,
+                    size_t new_size,
+                    void* context)
+{
+    PoolCache* cache = context;
+    (void)old_size;
+    return new_size <= cache->depot->pool->chunk_size ? start : NULL;
+}
+
+static void*
+concurrent_pool_alloc_(size_t bytes, void* context)
+{
+    assert(bytes <= ((ConcurrentPool*)context)->chunk_size &&
+           "Size was larger than chunk size");
+    return concurrent_pool_allocate((ConcurrentPool*)context);
+}
+
+static void
+concurrent_pool_free_(void* ptr, size_t bytes, void* context)
+{
+    (void)bytes;
+    concurrent_pool_free((ConcurrentPool*)context, ptr);
+}
+
+static void*
+concurrent_pool_realloc_(void* start,
+                         size_t old_size,
+                         size_t new_size,
+                         void* context)
+{
+    ConcurrentPool* pool = context;
+    (void)old_size;
+    return new_size <= pool->chunk_size ? start : NULL;
+}
+
 static void*
 buddy_alloc_(size_t bytes, void* context)
 {
@@ -357,22 +852,21 @@ buddy_realloc_(void* start, size_t old_size, size_t new_size, void* context)
            new_size);
 #endif
     BuddyAllocator* buddy_allocator = context;
-    BuddyBlock* block =
-      (BuddyBlock*)((uintptr_t)start - buddy_allocator->alignment);
 
-    if (new_size > old_size && new_size < block->size) {
+    if (buddy_allocator_resize(buddy_allocator, start, new_size)) {
 #ifdef CCORE_VERBOSE
-        printf("Block size %lu was sufficient.\n", block->size);
+        printf("Block was resized in place.\n");
 #endif
         return start;
     }
 
-    buddy_allocator_free(buddy_allocator, start);
+    /* Copy before freeing, a freed block's payload holds free list links. */
     void* new_start = buddy_allocator_alloc(buddy_allocator, new_size);
     if (new_start == NULL)
         return NULL;
     size_t smaller_size = old_size > new_size ? new_size : old_size;
     memcpy(new_start, start, smaller_size);
+    buddy_allocator_free(buddy_allocator, start);
     return new_start;
 }
 
@@ -420,29 +914,71 @@ pool_allocator(Pool* pool)
     };
 }
 
-void
-pool_free_all(Pool* p)
+Allocator
+slab_allocator(SlabAllocator* slab)
 {
-    size_t chunk_count = p->capacity / p->chunk_size;
-    size_t i;
-
-    for (i = 0; i < chunk_count; i++) {
-        void* ptr          = &p->base[i * p->chunk_size];
-        PoolFreeNode* node = (PoolFreeNode*)ptr;
-        node->next         = p->head;
-        p->head            = node;
-    }
+    return (Allocator){
+        .alloc   = slab_alloc_,
+        .realloc = slab_realloc_,
+        .free    = slab_free_,
+        .context = slab,
+    };
 }
 
-void
-pool_init(Pool* pool,
-          void* base,
-          size_t capacity,
-          size_t chunk_size,
-          size_t chunk_alignment)
+Allocator
+pool_cache_allocator(PoolCache* cache)
 {
-    uintptr_t initial_start = (uintptr_t)base;
-    uintptr_t start = align_forward(initial_start, (uintptr_t)chunk_alignment);
+    return (Allocator){
+        .alloc   = pool_cache_alloc_,
+        .realloc = pool_cache_realloc_,
+        .free    = pool_cache_free_,
+        .context = cache,
+    };
+}
+
+Allocator
+concurrent_pool_allocator(ConcurrentPool* pool)
+{
+    return (Allocator){
+        .alloc   = concurrent_pool_alloc_,
+        .realloc = concurrent_pool_realloc_,
+        .free    = concurrent_pool_free_,
+        .context = pool,
+    };
+}
+
+/* Pushes the chunks of one slab, lowest address ending up on top. */
+static void
+pool_thread_slab(Pool* p, size_t slab)
+{
+    u8* start          = &p->base[slab * p->slab_size];
+    size_t chunk_count = p->slab_size / p->chunk_size;
+    size_t i;
+
+    for (i = chunk_count; i > 0; i--) {
+        PoolFreeNode* node = (PoolFreeNode*)&start[(i - 1) * p->chunk_size];
+        node->next         = p->head;
+        p->head            = node;
+    }
+}
+
+void
+pool_free_all(Pool* p)
+{
+    p->head       = NULL;
+    p->bump       = 0;
+    p->bump_limit = 0;
+}
+
+void
+pool_init(Pool* pool,
+          void* base,
+          size_t capacity,
+          size_t chunk_size,
+          size_t chunk_alignment)
+{
+    uintptr_t initial_start = (uintptr_t)base;
+    uintptr_t start = align_forward(initial_start, (uintptr_t)chunk_alignment);
     capacity -= (size_t)(start - initial_start);
 
     chunk_size = align_forward(chunk_size, chunk_alignment);
@@ -451,10 +987,16 @@ pool_init(Pool* pool,
     assert(capacity >= chunk_size &&
            "Backing buffer length is smaller than the chunk size");
 
-    pool->base       = (unsigned char*)base;
-    pool->capacity   = capacity;
-    pool->chunk_size = chunk_size;
-    pool->head       = NULL;
+    pool->base        = (u8*)start;
+    pool->capacity    = capacity;
+    pool->chunk_size  = chunk_size;
+    pool->head        = NULL;
+    pool->zero_chunks = false;
+    pool->reservation = NULL;
+    pool->reserved    = 0;
+    pool->slab_size   = capacity;
+    pool->slabs       = NULL;
+    pool->decommitted = 0;
 #ifdef CCORE_VERBOSE
     CSV_LOG_POOL(pool, "INIT", pool->base, pool->capacity, "");
 #endif
@@ -462,658 +1004,2613 @@ pool_init(Pool* pool,
     pool_free_all(pool);
 }
 
-void*
-pool_allocate(Pool* p)
+int
+pool_init_virtual(Pool* pool,
+                  size_t reserve,
+                  size_t chunk_size,
+                  size_t chunk_alignment)
 {
-    PoolFreeNode* node = p->head;
+    size_t page_size = system_page_size();
+    size_t slab_size, table_size;
+    void* reservation;
 
-    if (node == NULL) {
-        fprintf(stderr, "Pool allocator has no free memory\n");
-        return NULL;
+    chunk_size = align_forward(chunk_size, chunk_alignment);
+    assert(chunk_size >= sizeof(PoolFreeNode) && "Chunk size is too small");
+    assert(chunk_alignment <= page_size && "Alignment is larger than a page");
+
+    slab_size = POOL_SLAB_SIZE;
+    if (slab_size < POOL_SLAB_MIN_CHUNKS * chunk_size) {
+        slab_size = POOL_SLAB_MIN_CHUNKS * chunk_size;
+    }
+    slab_size  = align_forward(slab_size, page_size);
+    table_size = align_forward(reserve / slab_size * sizeof(u32), page_size);
+    if (reserve < table_size + slab_size) {
+        fprintf(stderr, "Pool reservation is smaller than a slab\n");
+        return 1;
+    }
+
+    reservation = vmem_reserve(reserve);
+    if (reservation == NULL) {
+        return 1;
+    }
+    /* The slab table is only written by pool_trim, committing it costs
+     * nothing until then. */
+    if (!vmem_commit(reservation, table_size)) {
+        vmem_release(reservation, reserve);
+        return 1;
     }
 
-    p->head = p->head->next;
+    pool->base        = (u8*)reservation + table_size;
+    pool->capacity    = 0;
+    pool->chunk_size  = chunk_size;
+    pool->head        = NULL;
+    pool->zero_chunks = false;
+    pool->reservation = reservation;
+    pool->reserved    = reserve;
+    pool->slab_size   = slab_size;
+    pool->slabs       = reservation;
+    pool->decommitted = 0;
+    pool_free_all(pool);
 #ifdef CCORE_VERBOSE
-    CSV_LOG_POOL(p, "ALLOC", node, p->chunk_size, "");
+    CSV_LOG_POOL(pool, "INIT", pool->base, reserve, "Reserved Virtual Space");
 #endif
-    return memset(node, 0, p->chunk_size);
+    return 0;
 }
 
 void
-pool_free(Pool* p, void* ptr)
+pool_destroy(Pool* pool)
 {
-    PoolFreeNode* node;
-
-    void* start = p->base;
-    void* end   = &p->base[p->capacity];
-
-    if (ptr == NULL) {
-        return;
+    if (pool->reservation != NULL) {
+        vmem_release(pool->reservation, pool->reserved);
     }
+    pool->base        = NULL;
+    pool->capacity    = 0;
+    pool->head        = NULL;
+    pool->reservation = NULL;
+    pool->slabs       = NULL;
+    pool_free_all(pool);
+}
 
-    if (!(start <= ptr && ptr < end)) {
-        assert(0 && "Memory is out of bounds of the buffer in this pool");
-        return;
+static bool
+pool_commit_slab(Pool* p, size_t slab)
+{
+    if (!vmem_commit(&p->base[slab * p->slab_size], p->slab_size)) {
+        return false;
     }
-
-    node       = (PoolFreeNode*)ptr;
-    node->next = p->head;
-    p->head    = node;
 #ifdef CCORE_VERBOSE
-    CSV_LOG_POOL(p, "FREE", ptr, p->chunk_size, "");
+    CSV_LOG_POOL(
+      p, "COMMIT", &p->base[slab * p->slab_size], p->slab_size, "Slab");
 #endif
+    return true;
 }
 
-static BuddyBlock*
-buddy_block_next(BuddyBlock* block)
+/* Moves the bump pointer to the start of the next slab, committing it if
+ * it lies past the committed range or was released by pool_trim. */
+static bool
+pool_bump_next_slab(Pool* p)
 {
-    return (BuddyBlock*)((char*)block + block->size);
-}
+    size_t slab = (p->bump + p->slab_size - 1) / p->slab_size;
 
-static BuddyBlock*
-buddy_block_split(BuddyBlock* block, size_t size)
-{
-    if (block != NULL && size != 0) {
-        while (size < block->size) {
-            size_t new_size = block->size >> 1;
-            block->size     = new_size;
-            block           = buddy_block_next(block);
-            block->size     = new_size;
-            block->is_free  = true;
+    if (slab * p->slab_size >= p->capacity) {
+        if (p->reservation == NULL ||
+            &p->base[p->capacity + p->slab_size] >
+              (u8*)p->reservation + p->reserved ||
+            !pool_commit_slab(p, slab)) {
+            return false;
         }
-
-        if (size <= block->size) {
-            return block;
+        p->capacity += p->slab_size;
+    } else if (p->slabs != NULL && p->slabs[slab] == POOL_SLAB_DECOMMITTED) {
+        if (!pool_commit_slab(p, slab)) {
+            return false;
         }
+        p->slabs[slab] = 0;
+        p->decommitted--;
     }
 
-    return NULL;
+    p->bump       = slab * p->slab_size;
+    p->bump_limit = p->bump + p->slab_size / p->chunk_size * p->chunk_size;
+    return true;
 }
 
-static BuddyBlock*
-buddy_block_find_best(BuddyBlock* head, BuddyBlock* tail, size_t size)
+/* Recommits the lowest slab that pool_trim released below the bump
+ * pointer. Released slabs from the bump slab on are left to
+ * pool_bump_next_slab, which hands them out in order. */
+static bool
+pool_reclaim_slab(Pool* p)
 {
-    BuddyBlock* best_block = NULL;
-    BuddyBlock* block      = head;
-    BuddyBlock* buddy      = buddy_block_next(block);
+    size_t below = p->bump / p->slab_size;
+    size_t slab;
 
-    if (buddy == tail && block->is_free) {
-        return buddy_block_split(block, size);
+    if (p->decommitted == 0) {
+        return false;
     }
-
-    while (block < tail && buddy < tail) {
-        /* Merge empty buddies with same size, reduces fragmentation
-         */
-        if (block->is_free && buddy->is_free && block->size == buddy->size) {
-            block->size <<= 1;
-            if (size <= block->size &&
-                (best_block == NULL || block->size <= best_block->size)) {
-                best_block = block;
-            }
-
-            block = buddy_block_next(buddy);
-            if (block < tail) {
-                buddy = buddy_block_next(block);
-            }
-            continue;
+    for (slab = 0; slab < below; slab++) {
+        if (p->slabs[slab] == POOL_SLAB_DECOMMITTED) {
+            break;
         }
+    }
+    if (slab == below || !pool_commit_slab(p, slab)) {
+        return false;
+    }
+    p->slabs[slab] = 0;
+    p->decommitted--;
+    pool_thread_slab(p, slab);
+    return true;
+}
 
-        /* The current block is suitable */
-        if (block->is_free && size <= block->size &&
-            (best_block == NULL || block->size <= best_block->size)) {
-            best_block = block;
-        }
+/* Takes a chunk from the free list, falling back to untouched memory under
+ * the bump pointer. Slabs released below the bump pointer are recommitted
+ * before the bump pointer moves on, so trimmed slabs are reused before the
+ * committed range is extended. Chunks are only written once handed out. */
+static void*
+pool_take(Pool* p)
+{
+    PoolFreeNode* node = p->head;
 
-        /* Pick the buddy if it has smaller size */
-        if (buddy->is_free && size <= buddy->size &&
-            (best_block == NULL || buddy->size < best_block->size)) {
-            best_block = buddy;
-        }
+    if (node != NULL) {
+        p->head = node->next;
+        return node;
+    }
 
-        if (block->size <= buddy->size) {
-            block = buddy_block_next(buddy);
-            if (block < tail) {
-                buddy = buddy_block_next(block);
-            }
-        } else {
-            block = buddy;
-            buddy = buddy_block_next(buddy);
-        }
+    if (p->bump + p->chunk_size > p->bump_limit && pool_reclaim_slab(p)) {
+        node    = p->head;
+        p->head = node->next;
+        return node;
     }
 
-    if (best_block != NULL) {
-        /* Handles the case where the best block is a perfect fit */
-        return buddy_block_split(best_block, size);
+    if (p->bump + p->chunk_size <= p->bump_limit || pool_bump_next_slab(p)) {
+        node = (PoolFreeNode*)&p->base[p->bump];
+        p->bump += p->chunk_size;
+        return node;
     }
 
     return NULL;
 }
 
-static bool
-is_power_of_two(size_t x)
+size_t
+pool_trim(Pool* p)
 {
-    return (x & (x - 1)) == 0;
-}
+    size_t slab_count  = p->capacity / p->slab_size;
+    size_t chunk_count = p->slab_size / p->chunk_size;
+    size_t bump_slab   = p->bump_limit / p->slab_size;
+    size_t released    = 0;
+    PoolFreeNode** link;
+    size_t i;
 
-void
-buddy_allocator_init(BuddyAllocator* buddy,
-                     void* data,
-                     size_t size,
-                     size_t alignment)
-{
-    assert(data != NULL);
-    assert(is_power_of_two(size) && "size is not a power-of-two");
-    assert(is_power_of_two(alignment) && "alignment is not a power-of-two");
+    if (p->slabs == NULL) {
+        return 0;
+    }
 
-    assert(is_power_of_two(sizeof(BuddyBlock)));
-    if (alignment < sizeof(BuddyBlock)) {
-        alignment = sizeof(BuddyBlock);
+    /* Slabs the bump pointer has not reached yet are entirely free, the
+     * one it is in is free from the bump pointer on. */
+    for (i = 0; i < slab_count; i++) {
+        if (p->slabs[i] != POOL_SLAB_DECOMMITTED) {
+            p->slabs[i] = i < bump_slab ? 0 : chunk_count;
+        }
+    }
+    if (p->bump_limit > 0) {
+        bump_slab = (p->bump_limit - 1) / p->slab_size;
+        p->slabs[bump_slab] = (p->bump_limit - p->bump) / p->chunk_size;
+    }
+    for (link = &p->head; *link != NULL; link = &(*link)->next) {
+        p->slabs[((u8*)*link - p->base) / p->slab_size]++;
     }
-    assert((uintptr_t)data % alignment == 0 &&
-           "data is not aligned to minimum alignment");
 
-    buddy->head          = (BuddyBlock*)data;
-    buddy->head->size    = size;
-    buddy->head->is_free = true;
+    /* Unlink the chunks of fully free slabs before their memory goes. */
+    link = &p->head;
+    while (*link != NULL) {
+        if (p->slabs[((u8*)*link - p->base) / p->slab_size] == chunk_count) {
+            *link = (*link)->next;
+        } else {
+            link = &(*link)->next;
+        }
+    }
 
-    buddy->tail = buddy_block_next(buddy->head);
+    for (i = 0; i < slab_count; i++) {
+        if (p->slabs[i] == chunk_count) {
+            vmem_decommit(&p->base[i * p->slab_size], p->slab_size);
+            p->slabs[i] = POOL_SLAB_DECOMMITTED;
+            p->decommitted++;
+            released += p->slab_size;
+        }
+    }
 
-    buddy->alignment = alignment;
+    /* If the bump slab was released, so was everything above it. Rewind
+     * the bump pointer to the start of that trailing run so it recommits
+     * the released slabs in order instead of growing past them. */
+    for (i = slab_count; i > 0; i--) {
+        if (p->slabs[i - 1] != POOL_SLAB_DECOMMITTED) {
+            break;
+        }
+    }
+    if (p->bump_limit > i * p->slab_size) {
+        p->bump       = i * p->slab_size;
+        p->bump_limit = p->bump;
+    }
 
 #ifdef CCORE_VERBOSE
-    CSV_LOG_BUDDY(buddy, "INIT", buddy->head, size, "");
+    CSV_LOG_POOL(p, "TRIM", p->base, released, "Decommitted free slabs");
 #endif
+    return released;
 }
 
+/* Takes up to count chunks, walking the free list once and cutting it
+ * after the last chunk taken before falling back to the bump pointer. */
 static size_t
-buddy_block_size_required(BuddyAllocator* b, size_t size)
+pool_take_n(Pool* p, void** chunks, size_t count)
 {
-    size_t actual_size = b->alignment;
+    PoolFreeNode* node = p->head;
+    size_t taken       = 0;
 
-    size += sizeof(BuddyBlock);
-    size = align_forward(size, b->alignment);
+    while (taken < count && node != NULL) {
+        chunks[taken++] = node;
+        node            = node->next;
+    }
+    p->head = node;
 
-    while (size > actual_size) {
-        actual_size <<= 1;
+    while (taken < count) {
+        void* chunk = pool_take(p);
+        if (chunk == NULL) {
+            break;
+        }
+        chunks[taken++] = chunk;
     }
 
-    return actual_size;
+    return taken;
 }
 
-static void
-buddy_block_coalescence(BuddyBlock* head, BuddyBlock* tail)
+void*
+pool_allocate_uninit(Pool* p)
 {
-    for (;;) {
-        BuddyBlock* block = head;
-        BuddyBlock* buddy = buddy_block_next(block);
-
-        bool no_coalescence = true;
-        while (block < tail && buddy < tail) {
-            if (block->is_free && buddy->is_free &&
-                block->size == buddy->size) {
-                block->size <<= 1;
-                block = buddy_block_next(block);
-                if (block < tail) {
-                    buddy          = buddy_block_next(block);
-                    no_coalescence = false;
-                }
-            } else if (block->size < buddy->size) {
-                block = buddy;
-                buddy = buddy_block_next(buddy);
-            } else {
-                block = buddy_block_next(buddy);
-                if (block < tail) {
-                    buddy = buddy_block_next(block);
-                }
-            }
-        }
+    void* node = pool_take(p);
 
-        if (no_coalescence) {
-            return;
-        }
+#ifdef CCORE_VERBOSE
+    if (node == NULL) {
+        fprintf(stderr, "Pool allocator has no free memory\n");
+        return NULL;
     }
+    CSV_LOG_POOL(p, "ALLOC", node, p->chunk_size, "");
+#endif
+    return node;
 }
 
 void*
-buddy_allocator_alloc(BuddyAllocator* buddy, size_t size)
+pool_allocate(Pool* p)
 {
+    void* node = pool_allocate_uninit(p);
+
+    if (node != NULL && p->zero_chunks) {
+        memset(node, 0, p->chunk_size);
+    }
+    return node;
+}
+
+size_t
+pool_allocate_n(Pool* p, void** chunks, size_t count)
+{
+    size_t taken = pool_take_n(p, chunks, count);
+    size_t i;
+
+    if (p->zero_chunks) {
+        for (i = 0; i < taken; i++) {
+            memset(chunks[i], 0, p->chunk_size);
+        }
+    }
 #ifdef CCORE_VERBOSE
-    printf("Buddy allocator allocate called %lu bytes\n", size);
+    CSV_LOG_POOL(p, "ALLOC_N", p->base, taken * p->chunk_size, "");
 #endif
-    if (size != 0) {
-        size_t actual_size = buddy_block_size_required(buddy, size);
+    return taken;
+}
+
+/* Links the chunks into a chain and splices it onto the free list once. */
+void
+pool_free_n(Pool* p, void** chunks, size_t count)
+{
+    PoolFreeNode* first = NULL;
+    PoolFreeNode* last  = NULL;
+    size_t i;
 
-        BuddyBlock* found =
-          buddy_block_find_best(buddy->head, buddy->tail, actual_size);
-        if (found == NULL) {
-            buddy_block_coalescence(buddy->head, buddy->tail);
-            found =
-              buddy_block_find_best(buddy->head, buddy->tail, actual_size);
+    for (i = 0; i < count; i++) {
+        PoolFreeNode* node = chunks[i];
+        if (node == NULL) {
+            continue;
         }
 
-        if (found != NULL) {
-            found->is_free = false;
-#ifdef CCORE_VERBOSE
-            CSV_LOG_BUDDY(buddy, "ALLOC", found, found->size, "");
-#endif
-            return (void*)((char*)found + buddy->alignment);
+        assert((void*)p->base <= (void*)node &&
+               (void*)node < (void*)&p->base[p->capacity] &&
+               "Memory is out of bounds of the buffer in this pool");
+        if (last == NULL) {
+            first = node;
+        } else {
+            last->next = node;
         }
+        last = node;
     }
 
+    if (last != NULL) {
+        last->next = p->head;
+        p->head    = first;
+    }
 #ifdef CCORE_VERBOSE
-    fprintf(stderr,
-            "No block with sufficient size was found. Size "
-            "requested: %lu bytes.\n",
-            size);
+    CSV_LOG_POOL(p, "FREE_N", p->base, count * p->chunk_size, "");
 #endif
-
-    return NULL;
 }
 
 void
-buddy_allocator_free(BuddyAllocator* buddy, void* data)
+pool_free(Pool* p, void* ptr)
 {
-    if (data != NULL) {
-        BuddyBlock* block;
+    PoolFreeNode* node;
 
-        assert((uintptr_t)buddy->head <= (uintptr_t)data);
-        assert((uintptr_t)data < (uintptr_t)buddy->tail);
+    void* start = p->base;
+    void* end   = &p->base[p->capacity];
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    if (!(start <= ptr && ptr < end)) {
+        assert(0 && "Memory is out of bounds of the buffer in this pool");
+        return;
+    }
 
-        block          = (BuddyBlock*)((char*)data - buddy->alignment);
-        block->is_free = true;
+    node       = (PoolFreeNode*)ptr;
+    node->next = p->head;
+    p->head    = node;
 #ifdef CCORE_VERBOSE
-        CSV_LOG_BUDDY(buddy, "FREE", block, block->size, "");
+    CSV_LOG_POOL(p, "FREE", ptr, p->chunk_size, "");
 #endif
-    }
 }
 
-void*
-array_init(size_t item_size, size_t capacity, Allocator* allocator)
+static const size_t slab_class_sizes[SLAB_CLASS_COUNT] = {
+    16,  32,  48,  64,  80,  96,   112,  128,  160,  192,  224,  256,
+    320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+};
+
+int
+slab_allocator_init(SlabAllocator* slab,
+                    size_t reserve_per_class,
+                    Allocator* fallback)
 {
-    size_t size         = item_size * capacity + sizeof(ArrayHeader);
-    ArrayHeader* header = allocator->alloc(size, allocator->context);
+    size_t class = 0;
+    size_t i;
 
-    void* ptr = NULL;
-    if (header) {
-        header->capacity = capacity;
-#ifdef CCORE_VERBOSE
-        /* printf("Array initialized with capacity %zu\n", capacity);
-         */
-#endif
-        header->length    = 0;
-        header->item_size = item_size;
-        header->allocator = allocator;
-        ptr               = header + 1;
+    /* class_of maps a size rounded up to 16 bytes to its class, so lookups
+     * on alloc and free are a single load. */
+    for (i = 0; i <= SLAB_MAX_SIZE / 16; i++) {
+        while (slab_class_sizes[class] < i * 16) {
+            class++;
+        }
+        slab->class_of[i] = (u8)class;
     }
 
-    return ptr;
+    for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+        if (pool_init_virtual(&slab->pools[i],
+                              reserve_per_class,
+                              slab_class_sizes[i],
+                              DEFAULT_ALIGNMENT) != 0) {
+            while (i > 0) {
+                pool_destroy(&slab->pools[--i]);
+            }
+            return 1;
+        }
+    }
+
+    slab->fallback = fallback;
+    return 0;
 }
 
-ArrayHeader*
-array_header(const void* arr)
+void
+slab_allocator_destroy(SlabAllocator* slab)
 {
-    return (ArrayHeader*)(arr)-1;
+    size_t i;
+    for (i = 0; i < SLAB_CLASS_COUNT; i++) {
+        pool_destroy(&slab->pools[i]);
+    }
 }
 
-size_t
-array_len(const void* a)
+void*
+slab_allocate(SlabAllocator* slab, size_t size)
 {
-    return array_header(a)->length;
+    if (size > SLAB_MAX_SIZE) {
+        if (slab->fallback == NULL) {
+            return NULL;
+        }
+        return slab->fallback->alloc(size, slab->fallback->context);
+    }
+    return pool_allocate_uninit(&slab->pools[slab->class_of[(size + 15) >> 4]]);
 }
 
+/* The size has to be the one the memory was allocated with, it is what
+ * picks the pool. */
 void
-array_remove(void* arr, size_t idx)
+slab_free(SlabAllocator* slab, void* ptr, size_t size)
 {
-    ArrayHeader* h = array_header(arr);
-    if (idx == h->length - 1) {
-        h->length -= 1;
-    } else if (h->length > 1 && idx < h->length) {
-        uintptr_t ptr  = (uintptr_t)arr + idx * h->item_size;
-        uintptr_t last = (uintptr_t)arr + (h->length - 1) * h->item_size;
-        h->length -= 1;
-        memcpy((void*)ptr, (void*)last, h->item_size);
+    if (ptr == NULL) {
+        return;
+    }
+    if (size > SLAB_MAX_SIZE) {
+        slab->fallback->free(ptr, size, slab->fallback->context);
+        return;
     }
+    pool_free(&slab->pools[slab->class_of[(size + 15) >> 4]], ptr);
 }
 
 void
-array_assign(void* dest, const void* src)
+pool_depot_init(PoolDepot* depot, Pool* pool, Allocator* allocator)
 {
-    int added_count = array_len(src) - array_len(dest);
-    if (added_count >= 0) {
-        array_ensure_capacity(dest, added_count);
+    depot->pool      = pool;
+    depot->allocator = allocator;
+    depot->full      = NULL;
+    depot->empty     = NULL;
+    depot->lock      = 0;
+    depot->pool_lock = 0;
+}
+
+/* Puts the chunks of a magazine back on the pool's free list. They are
+ * chained outside of the lock so only a single splice happens under it. */
+static void
+pool_depot_release(PoolDepot* depot, PoolMagazine* magazine)
+{
+    PoolFreeNode* first;
+    PoolFreeNode* last;
+    size_t i;
+
+    if (magazine->count == 0) {
+        return;
     }
 
-    memcpy(dest, src, array_header(src)->item_size * array_len(src));
-    array_header(dest)->length = array_len(src);
+    first = magazine->rounds[0];
+    last  = first;
+    for (i = 1; i < magazine->count; i++) {
+        last->next = magazine->rounds[i];
+        last       = last->next;
+    }
+    magazine->count = 0;
+
+    spin_lock(&depot->pool_lock);
+    last->next        = depot->pool->head;
+    depot->pool->head = first;
+    spin_unlock(&depot->pool_lock);
+}
+
+/* An empty magazine from the depot, or a newly allocated one. */
+static PoolMagazine*
+pool_depot_take_empty(PoolDepot* depot)
+{
+    PoolMagazine* magazine;
+
+    spin_lock(&depot->lock);
+    magazine = depot->empty;
+    if (magazine != NULL) {
+        depot->empty = magazine->next;
+    }
+    spin_unlock(&depot->lock);
+
+    if (magazine == NULL) {
+        magazine = depot->allocator->alloc(sizeof(PoolMagazine),
+                                           depot->allocator->context);
+        if (magazine != NULL) {
+            magazine->count = 0;
+        }
+    }
+    return magazine;
+}
+
+static void
+pool_depot_give_empty(PoolDepot* depot, PoolMagazine* magazine)
+{
+    spin_lock(&depot->lock);
+    magazine->next = depot->empty;
+    depot->empty   = magazine;
+    spin_unlock(&depot->lock);
+}
+
+/* Trades an empty magazine for a full one. When the depot has none, the
+ * magazine is refilled from the pool instead. */
+static PoolMagazine*
+pool_depot_exchange_empty(PoolDepot* depot, PoolMagazine* empty)
+{
+    PoolMagazine* full;
+
+    spin_lock(&depot->lock);
+    full = depot->full;
+    if (full != NULL) {
+        depot->full  = full->next;
+        empty->next  = depot->empty;
+        depot->empty = empty;
+    }
+    spin_unlock(&depot->lock);
+
+    if (full != NULL) {
+        return full;
+    }
+
+    spin_lock(&depot->pool_lock);
+    empty->count = pool_take_n(depot->pool, empty->rounds, POOL_MAGAZINE_SIZE);
+    spin_unlock(&depot->pool_lock);
+    return empty;
+}
+
+/* Trades a full magazine for an empty one. If no empty magazine can be
+ * allocated, the chunks go back to the pool and the same magazine is
+ * returned. */
+static PoolMagazine*
+pool_depot_exchange_full(PoolDepot* depot, PoolMagazine* full)
+{
+    PoolMagazine* empty = pool_depot_take_empty(depot);
+
+    if (empty == NULL) {
+        pool_depot_release(depot, full);
+        return full;
+    }
+
+    spin_lock(&depot->lock);
+    full->next  = depot->full;
+    depot->full = full;
+    spin_unlock(&depot->lock);
+    return empty;
+}
+
+void
+pool_depot_destroy(PoolDepot* depot)
+{
+    Allocator* allocator = depot->allocator;
+
+    while (depot->full != NULL) {
+        PoolMagazine* magazine = depot->full;
+        depot->full            = magazine->next;
+        pool_depot_release(depot, magazine);
+        allocator->free(magazine, sizeof(PoolMagazine), allocator->context);
+    }
+    while (depot->empty != NULL) {
+        PoolMagazine* magazine = depot->empty;
+        depot->empty           = magazine->next;
+        allocator->free(magazine, sizeof(PoolMagazine), allocator->context);
+    }
+}
+
+int
+pool_cache_init(PoolCache* cache, PoolDepot* depot)
+{
+    cache->depot    = depot;
+    cache->loaded   = pool_depot_take_empty(depot);
+    cache->previous = pool_depot_take_empty(depot);
+
+    if (cache->loaded == NULL || cache->previous == NULL) {
+        if (cache->loaded != NULL) {
+            pool_depot_give_empty(depot, cache->loaded);
+        }
+        if (cache->previous != NULL) {
+            pool_depot_give_empty(depot, cache->previous);
+        }
+        cache->loaded   = NULL;
+        cache->previous = NULL;
+        return 1;
+    }
+    return 0;
 }
 
 void*
-array_copy(const void* original, Allocator* allocator)
+pool_cache_allocate(PoolCache* cache)
 {
-    ArrayHeader original_header = *array_header(original);
-    size_t copy_size = original_header.item_size * original_header.length;
-    void* result     = array_init(sizeof(uint8_t), copy_size, allocator);
-    memcpy(result, original, copy_size);
-    ArrayHeader* result_header = array_header(result);
-    *result_header             = *array_header(original);
+    PoolMagazine* loaded = cache->loaded;
 
-    return result;
+    if (loaded->count == 0) {
+        if (cache->previous->count == 0) {
+            loaded = pool_depot_exchange_empty(cache->depot, loaded);
+            cache->loaded = loaded;
+            if (loaded->count == 0) {
+#ifdef CCORE_VERBOSE
+                fprintf(stderr, "Pool allocator has no free memory\n");
+#endif
+                return NULL;
+            }
+        } else {
+            cache->loaded   = cache->previous;
+            cache->previous = loaded;
+            loaded          = cache->loaded;
+        }
+    }
+
+    return loaded->rounds[--loaded->count];
+}
+
+void
+pool_cache_free(PoolCache* cache, void* ptr)
+{
+    Pool* pool           = cache->depot->pool;
+    PoolMagazine* loaded = cache->loaded;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    assert((void*)pool->base <= ptr &&
+           ptr < (void*)&pool->base[pool->capacity] &&
+           "Memory is out of bounds of the buffer in this pool");
+
+    if (loaded->count == POOL_MAGAZINE_SIZE) {
+        if (cache->previous->count == POOL_MAGAZINE_SIZE) {
+            cache->previous =
+              pool_depot_exchange_full(cache->depot, cache->previous);
+        }
+        cache->loaded   = cache->previous;
+        cache->previous = loaded;
+        loaded          = cache->loaded;
+    }
+
+    loaded->rounds[loaded->count++] = ptr;
+}
+
+/* Returns every cached chunk to the pool and both magazines to the depot.
+ * Call before the thread exits; the cache must be initialised again before
+ * it is reused. */
+void
+pool_cache_flush(PoolCache* cache)
+{
+    pool_depot_release(cache->depot, cache->loaded);
+    pool_depot_release(cache->depot, cache->previous);
+    pool_depot_give_empty(cache->depot, cache->loaded);
+    pool_depot_give_empty(cache->depot, cache->previous);
+    cache->loaded   = NULL;
+    cache->previous = NULL;
+}
+
+#define CONCURRENT_POOL_INDEX_MASK 0xFFFFFFFFULL
+
+static PoolFreeNode*
+concurrent_pool_chunk(ConcurrentPool* pool, uint64_t head)
+{
+    size_t index = (size_t)(head & CONCURRENT_POOL_INDEX_MASK);
+    return (PoolFreeNode*)&pool->base[(index - 1) * pool->chunk_size];
+}
+
+static uint64_t
+concurrent_pool_next_head(uint64_t head, uint64_t index)
+{
+    return ((head >> 32) + 1) << 32 | index;
+}
+
+void
+concurrent_pool_init(ConcurrentPool* pool,
+                     void* base,
+                     size_t capacity,
+                     size_t chunk_size,
+                     size_t chunk_alignment)
+{
+    uintptr_t initial_start = (uintptr_t)base;
+    uintptr_t start = align_forward(initial_start, (uintptr_t)chunk_alignment);
+    size_t chunk_count;
+    size_t i;
+
+    capacity -= (size_t)(start - initial_start);
+    chunk_size = align_forward(chunk_size, chunk_alignment);
+
+    assert(chunk_size >= sizeof(PoolFreeNode) && "Chunk size is too small");
+    assert(capacity >= chunk_size &&
+           "Backing buffer length is smaller than the chunk size");
+
+    chunk_count = capacity / chunk_size;
+    assert(chunk_count < CONCURRENT_POOL_INDEX_MASK &&
+           "Too many chunks for a concurrent pool");
+
+    pool->base        = (u8*)start;
+    pool->capacity    = capacity;
+    pool->chunk_size  = chunk_size;
+    pool->zero_chunks = false;
+
+    /* Nodes store the index + 1 of the next chunk instead of a pointer. */
+    for (i = 0; i < chunk_count; i++) {
+        PoolFreeNode* node = (PoolFreeNode*)&pool->base[i * chunk_size];
+        node->next         = (PoolFreeNode*)(uintptr_t)i;
+    }
+    __atomic_store_n(&pool->head, (uint64_t)chunk_count, __ATOMIC_RELEASE);
+#ifdef CCORE_VERBOSE
+    CSV_LOG_POOL(pool, "INIT", pool->base, pool->capacity, "Concurrent");
+#endif
 }
 
 void*
-array_ensure_capacity(void* arr, size_t added_count)
+concurrent_pool_allocate(ConcurrentPool* pool)
 {
-    ArrayHeader* old_header = array_header(arr);
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    PoolFreeNode* node;
 
-    size_t desired_capacity = old_header->length + added_count;
-    if (desired_capacity <= old_header->capacity) {
-        return arr;
+    for (;;) {
+        uint64_t next;
+        if ((head & CONCURRENT_POOL_INDEX_MASK) == 0) {
+#ifdef CCORE_VERBOSE
+            fprintf(stderr, "Pool allocator has no free memory\n");
+#endif
+            return NULL;
+        }
+
+        /* The chunk may already be owned by another thread, in which case
+         * next is garbage and the generation makes the CAS fail. */
+        node = concurrent_pool_chunk(pool, head);
+        next = (uintptr_t)__atomic_load_n(&node->next, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&pool->head,
+                                        &head,
+                                        concurrent_pool_next_head(head, next),
+                                        true,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE)) {
+            break;
+        }
     }
 
-    /* Realloc array */
-    size_t new_capacity = 2 * old_header->capacity;
-    if (new_capacity == 0)
-        new_capacity = 1;
-    while (new_capacity < desired_capacity) {
-        new_capacity *= 2;
+#ifdef CCORE_VERBOSE
+    CSV_LOG_POOL(pool, "ALLOC", node, pool->chunk_size, "Concurrent");
+#endif
+    return pool->zero_chunks ? memset(node, 0, pool->chunk_size) : node;
+}
+
+void
+concurrent_pool_free(ConcurrentPool* pool, void* ptr)
+{
+    PoolFreeNode* node = ptr;
+    uint64_t index;
+    uint64_t head;
+
+    if (ptr == NULL) {
+        return;
     }
 
-    size_t old_size =
-      sizeof(ArrayHeader) + old_header->capacity * old_header->item_size;
-    size_t new_size =
-      sizeof(ArrayHeader) + new_capacity * old_header->item_size;
+    if (!((void*)pool->base <= ptr &&
+          ptr < (void*)&pool->base[pool->capacity])) {
+        assert(0 && "Memory is out of bounds of the buffer in this pool");
+        return;
+    }
 
+    index = ((u8*)ptr - pool->base) / pool->chunk_size + 1;
+    head  = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    for (;;) {
+        uintptr_t next = (uintptr_t)(head & CONCURRENT_POOL_INDEX_MASK);
+        __atomic_store_n(&node->next, (PoolFreeNode*)next, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&pool->head,
+                                        &head,
+                                        concurrent_pool_next_head(head, index),
+                                        true,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
 #ifdef CCORE_VERBOSE
-    /* printf(
-       "Reallocing array from %zu bytes to %zu bytes.\n", old_size,
-       new_size);
-     */
+    CSV_LOG_POOL(pool, "FREE", ptr, pool->chunk_size, "Concurrent");
 #endif
-    ArrayHeader* new_header = old_header->allocator->realloc(
-      old_header, old_size, new_size, old_header->allocator->context);
+}
 
-    if (new_header == NULL) {
+static size_t
+buddy_block_order(BuddyAllocator* buddy, size_t size)
+{
+    size_t order = 0;
+    while ((buddy->min_block_size << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+/* Buddies differ only in the bit of their offset that equals their size. */
+static BuddyBlock*
+buddy_block_buddy(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    uintptr_t offset = (uintptr_t)block - (uintptr_t)buddy->head;
+    return (BuddyBlock*)((char*)buddy->head +
+                         (offset ^ (buddy->min_block_size << order)));
+}
+
+/* Index of a block in the implicit binary tree, root first. The block may
+ * be any descendant of the node, the offset is truncated to the order. */
+static size_t
+buddy_tree_index(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    size_t depth  = buddy->order_count - 1 - order;
+    size_t offset = (uintptr_t)block - (uintptr_t)buddy->head;
+    return ((size_t)1 << depth) - 1 +
+           (offset >> (buddy->min_block_shift + order));
+}
+
+static bool
+bitmap_get(const uint64_t* bits, size_t index)
+{
+    return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static void
+bitmap_set(uint64_t* bits, size_t index, bool value)
+{
+    uint64_t mask = (uint64_t)1 << (index & 63);
+    if (value) {
+        bits[index >> 6] |= mask;
+    } else {
+        bits[index >> 6] &= ~mask;
+    }
+}
+
+static bool
+buddy_block_is_free(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    if (buddy->free_bits != NULL) {
+        return bitmap_get(buddy->free_bits,
+                          buddy_tree_index(buddy, block, order));
+    }
+    return block->is_free && block->size == buddy->min_block_size << order;
+}
+
+static void
+buddy_block_mark(BuddyAllocator* buddy,
+                 BuddyBlock* block,
+                 size_t order,
+                 bool is_free)
+{
+    if (buddy->free_bits != NULL) {
+        bitmap_set(
+          buddy->free_bits, buddy_tree_index(buddy, block, order), is_free);
+    } else {
+        block->size    = buddy->min_block_size << order;
+        block->is_free = is_free;
+    }
+}
+
+/* Inline headers encode splits through their sizes, only bitmap mode needs
+ * to record them. */
+static void
+buddy_block_mark_split(BuddyAllocator* buddy,
+                       BuddyBlock* block,
+                       size_t order,
+                       bool is_split)
+{
+    if (buddy->split_bits != NULL) {
+        bitmap_set(
+          buddy->split_bits, buddy_tree_index(buddy, block, order), is_split);
+    }
+}
+
+/* Order of the allocated block starting at block. In bitmap mode this
+ * descends from the root along split nodes. */
+static size_t
+buddy_block_allocated_order(BuddyAllocator* buddy, BuddyBlock* block)
+{
+    if (buddy->split_bits != NULL) {
+        size_t order = buddy->order_count - 1;
+        while (order > 0 &&
+               bitmap_get(buddy->split_bits,
+                          buddy_tree_index(buddy, block, order))) {
+            order--;
+        }
+        return order;
+    }
+    return buddy_block_order(buddy, block->size);
+}
+
+static BuddyFreeNode*
+buddy_block_node(BuddyAllocator* buddy, BuddyBlock* block)
+{
+    return (BuddyFreeNode*)((char*)block + buddy->header_size);
+}
+
+static BuddyBlock*
+buddy_node_block(BuddyAllocator* buddy, BuddyFreeNode* node)
+{
+    return (BuddyBlock*)((char*)node - buddy->header_size);
+}
+
+static void
+buddy_free_list_push(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    BuddyFreeNode* node  = buddy_block_node(buddy, block);
+    BuddyFreeNode** list = &buddy->free_lists[order];
+
+    buddy_block_mark(buddy, block, order, true);
+    node->prev = NULL;
+    node->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = node;
+    }
+    *list = node;
+}
+
+static void
+buddy_free_list_remove(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    BuddyFreeNode* node = buddy_block_node(buddy, block);
+
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        buddy->free_lists[order] = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    }
+    buddy_block_mark(buddy, block, order, false);
+}
+
+/* Pops the smallest free block of at least the given order and splits it
+ * down, returning the upper halves to their free lists. */
+static BuddyBlock*
+buddy_block_take(BuddyAllocator* buddy, size_t order)
+{
+    BuddyBlock* block;
+    size_t current = order;
+
+    while (current < buddy->order_count &&
+           buddy->free_lists[current] == NULL) {
+        current++;
+    }
+    if (current >= buddy->order_count) {
         return NULL;
     }
 
-    new_header->capacity = new_capacity;
-    return new_header + 1;
+    block = buddy_node_block(buddy, buddy->free_lists[current]);
+    buddy_free_list_remove(buddy, block, current);
+
+    while (current > order) {
+        buddy_block_mark_split(buddy, block, current, true);
+        current--;
+        buddy_free_list_push(
+          buddy,
+          (BuddyBlock*)((char*)block + (buddy->min_block_size << current)),
+          current);
+    }
+    buddy_block_mark(buddy, block, order, false);
+
+    return block;
+}
+
+static bool
+is_power_of_two(size_t x)
+{
+    return (x & (x - 1)) == 0;
+}
+
+static void
+buddy_allocator_reset(BuddyAllocator* buddy, void* data, size_t size)
+{
+    size_t i;
+
+    assert(size >= buddy->min_block_size && "size is too small");
+
+    buddy->min_block_shift = 0;
+    while (((size_t)1 << buddy->min_block_shift) < buddy->min_block_size) {
+        buddy->min_block_shift++;
+    }
+    buddy->order_count = 0;
+    while ((buddy->min_block_size << buddy->order_count) <= size) {
+        buddy->order_count++;
+    }
+    for (i = 0; i < BUDDY_ORDER_COUNT; i++) {
+        buddy->free_lists[i] = NULL;
+    }
+
+    buddy->head = (BuddyBlock*)data;
+    buddy->tail = (BuddyBlock*)((char*)data + size);
+    buddy_free_list_push(buddy, buddy->head, buddy->order_count - 1);
+}
+
+void
+buddy_allocator_init(BuddyAllocator* buddy,
+                     void* data,
+                     size_t size,
+                     size_t alignment)
+{
+    assert(data != NULL);
+    assert(is_power_of_two(size) && "size is not a power-of-two");
+    assert(is_power_of_two(alignment) && "alignment is not a power-of-two");
+
+    assert(is_power_of_two(sizeof(BuddyBlock)));
+    if (alignment < sizeof(BuddyBlock)) {
+        alignment = sizeof(BuddyBlock);
+    }
+    assert((uintptr_t)data % alignment == 0 &&
+           "data is not aligned to minimum alignment");
+
+    /* A free block has to hold its header and its free list links. */
+    buddy->min_block_size = alignment;
+    while (buddy->min_block_size < alignment + sizeof(BuddyFreeNode)) {
+        buddy->min_block_size <<= 1;
+    }
+
+    buddy->alignment   = alignment;
+    buddy->header_size = alignment;
+    buddy->split_bits  = NULL;
+    buddy->free_bits   = NULL;
+    buddy_allocator_reset(buddy, data, size);
+
+#ifdef CCORE_VERBOSE
+    CSV_LOG_BUDDY(buddy, "INIT", buddy->head, size, "");
+#endif
+}
+
+/* Bytes of one bitmap, one bit per node of the block tree, rounded up to
+ * whole 64-bit words. */
+static size_t
+buddy_bitmap_size(size_t size, size_t min_block_size)
+{
+    size_t node_count = 2 * (size / min_block_size) - 1;
+    return ((node_count + 63) / 64) * sizeof(uint64_t);
+}
+
+size_t
+buddy_allocator_metadata_size(size_t size, size_t min_block_size)
+{
+    return 2 * buddy_bitmap_size(size, min_block_size);
+}
+
+void
+buddy_allocator_init_bitmap(BuddyAllocator* buddy,
+                            void* data,
+                            size_t size,
+                            size_t min_block_size,
+                            void* metadata)
+{
+    size_t bitmap_size = buddy_bitmap_size(size, min_block_size);
+
+    assert(data != NULL && metadata != NULL);
+    assert(is_power_of_two(size) && "size is not a power-of-two");
+    assert(is_power_of_two(min_block_size) &&
+           "min_block_size is not a power-of-two");
+    assert(min_block_size >= sizeof(BuddyFreeNode) &&
+           "min_block_size cannot hold the free list links");
+    /* Blocks are aligned to their size relative to data, so their address
+     * alignment is capped by the alignment of data itself. */
+    assert((uintptr_t)data %
+               (min_block_size < DEFAULT_ALIGNMENT ? min_block_size
+                                                   : DEFAULT_ALIGNMENT) ==
+             0 &&
+           "data is not aligned to the default alignment");
+    assert((uintptr_t)metadata % sizeof(uint64_t) == 0 &&
+           "metadata is not aligned to 8 bytes");
+
+    memset(metadata, 0, 2 * bitmap_size);
+
+    buddy->alignment      = min_block_size;
+    buddy->header_size    = 0;
+    buddy->min_block_size = min_block_size;
+    buddy->split_bits     = (uint64_t*)metadata;
+    buddy->free_bits      = (uint64_t*)((char*)metadata + bitmap_size);
+    buddy_allocator_reset(buddy, data, size);
+
+#ifdef CCORE_VERBOSE
+    CSV_LOG_BUDDY(buddy, "INIT", buddy->head, size, "Bitmap metadata");
+#endif
+}
+
+size_t
+buddy_allocator_block_size(BuddyAllocator* buddy, const void* data)
+{
+    BuddyBlock* block = (BuddyBlock*)((char*)data - buddy->header_size);
+    size_t order      = buddy_block_allocated_order(buddy, block);
+    return (buddy->min_block_size << order) - buddy->header_size;
+}
+
+/* Returns 0 when the request cannot fit in the heap at all. */
+static size_t
+buddy_block_size_required(BuddyAllocator* b, size_t size)
+{
+    size_t heap_size   = (uintptr_t)b->tail - (uintptr_t)b->head;
+    size_t actual_size = b->min_block_size;
+
+    if (size > heap_size - b->header_size) {
+        return 0;
+    }
+
+    size += b->header_size;
+    size = align_forward(size, b->alignment);
+
+    while (size > actual_size) {
+        actual_size <<= 1;
+    }
+
+    return actual_size;
+}
+
+/* Frees a block and merges it with its buddy, order by order, for as long
+ * as the buddy is free and whole. */
+static void
+buddy_block_release(BuddyAllocator* buddy, BuddyBlock* block, size_t order)
+{
+    while (order + 1 < buddy->order_count) {
+        BuddyBlock* other = buddy_block_buddy(buddy, block, order);
+        if (!buddy_block_is_free(buddy, other, order)) {
+            break;
+        }
+
+        buddy_free_list_remove(buddy, other, order);
+        if (other < block) {
+            block = other;
+        }
+        order++;
+        buddy_block_mark_split(buddy, block, order, false);
+    }
+
+    buddy_free_list_push(buddy, block, order);
+}
+
+void*
+buddy_allocator_alloc(BuddyAllocator* buddy, size_t size)
+{
+#ifdef CCORE_VERBOSE
+    printf("Buddy allocator allocate called %lu bytes\n", size);
+#endif
+    if (size != 0) {
+        size_t actual_size = buddy_block_size_required(buddy, size);
+
+        if (actual_size != 0) {
+            size_t order      = buddy_block_order(buddy, actual_size);
+            BuddyBlock* found = buddy_block_take(buddy, order);
+
+            if (found != NULL) {
+#ifdef CCORE_VERBOSE
+                CSV_LOG_BUDDY(buddy, "ALLOC", found, actual_size, "");
+#endif
+                return (void*)((char*)found + buddy->header_size);
+            }
+        }
+    }
+
+#ifdef CCORE_VERBOSE
+    fprintf(stderr,
+            "No block with sufficient size was found. Size "
+            "requested: %lu bytes.\n",
+            size);
+#endif
+
+    return NULL;
+}
+
+/* Grows a block by absorbing its free upper buddies, order by order. Only
+ * succeeds if every buddy up to the target order is free and whole. */
+static bool
+buddy_block_grow(BuddyAllocator* buddy,
+                 BuddyBlock* block,
+                 size_t order,
+                 size_t target)
+{
+    uintptr_t offset = (uintptr_t)block - (uintptr_t)buddy->head;
+    size_t current;
+
+    for (current = order; current < target; current++) {
+        BuddyBlock* upper;
+        if (offset & (buddy->min_block_size << current)) {
+            return false;
+        }
+        upper =
+          (BuddyBlock*)((char*)block + (buddy->min_block_size << current));
+        if (!buddy_block_is_free(buddy, upper, current)) {
+            return false;
+        }
+    }
+
+    for (current = order; current < target; current++) {
+        buddy_free_list_remove(
+          buddy,
+          (BuddyBlock*)((char*)block + (buddy->min_block_size << current)),
+          current);
+        buddy_block_mark_split(buddy, block, current + 1, false);
+    }
+    buddy_block_mark(buddy, block, target, false);
+    return true;
+}
+
+/* Splits a block down to the target order, handing the upper halves back.
+ * Their buddies are part of the block, so nothing can merge. */
+static void
+buddy_block_shrink(BuddyAllocator* buddy,
+                   BuddyBlock* block,
+                   size_t order,
+                   size_t target)
+{
+    while (order > target) {
+        buddy_block_mark_split(buddy, block, order, true);
+        order--;
+        buddy_free_list_push(
+          buddy,
+          (BuddyBlock*)((char*)block + (buddy->min_block_size << order)),
+          order);
+    }
+    buddy_block_mark(buddy, block, target, false);
+}
+
+bool
+buddy_allocator_resize(BuddyAllocator* buddy, void* data, size_t size)
+{
+    BuddyBlock* block = (BuddyBlock*)((char*)data - buddy->header_size);
+    size_t order      = buddy_block_allocated_order(buddy, block);
+    size_t required   = buddy_block_size_required(buddy, size);
+    size_t target;
+
+    if (size == 0 || required == 0) {
+        return false;
+    }
+
+    target = buddy_block_order(buddy, required);
+    if (target > order) {
+        if (!buddy_block_grow(buddy, block, order, target)) {
+            return false;
+        }
+    } else if (target < order) {
+        buddy_block_shrink(buddy, block, order, target);
+    }
+
+#ifdef CCORE_VERBOSE
+    CSV_LOG_BUDDY(buddy, "RESIZE", block, required, "");
+#endif
+    return true;
+}
+
+void
+buddy_allocator_free(BuddyAllocator* buddy, void* data)
+{
+    if (data != NULL) {
+        BuddyBlock* block;
+        size_t order;
+
+        assert((uintptr_t)buddy->head <= (uintptr_t)data);
+        assert((uintptr_t)data < (uintptr_t)buddy->tail);
+
+        block = (BuddyBlock*)((char*)data - buddy->header_size);
+        order = buddy_block_allocated_order(buddy, block);
+        assert(!buddy_block_is_free(buddy, block, order) &&
+               "Block was already freed");
+#ifdef CCORE_VERBOSE
+        CSV_LOG_BUDDY(
+          buddy, "FREE", block, buddy->min_block_size << order, "");
+#endif
+        buddy_block_release(buddy, block, order);
+    }
+}
+
+void*
+array_init(size_t item_size, size_t capacity, Allocator* allocator)
+{
+    size_t size         = item_size * capacity + sizeof(ArrayHeader);
+    ArrayHeader* header = allocator->alloc(size, allocator->context);
+
+    void* ptr = NULL;
+    if (header) {
+        header->capacity = capacity;
+#ifdef CCORE_VERBOSE
+        /* printf("Array initialized with capacity %zu\n", capacity);
+         */
+#endif
+        header->length    = 0;
+        header->item_size = item_size;
+        header->allocator = allocator;
+        ptr               = header + 1;
+    }
+
+    return ptr;
+}
+
+ArrayHeader*
+array_header(const void* arr)
+{
+    return (ArrayHeader*)(arr)-1;
+}
+
+size_t
+array_len(const void* a)
+{
+    return array_header(a)->length;
+}
+
+void
+array_remove(void* arr, size_t idx)
+{
+    ArrayHeader* h = array_header(arr);
+    if (idx == h->length - 1) {
+        h->length -= 1;
+    } else if (h->length > 1 && idx < h->length) {
+        uintptr_t ptr  = (uintptr_t)arr + idx * h->item_size;
+        uintptr_t last = (uintptr_t)arr + (h->length - 1) * h->item_size;
+        h->length -= 1;
+        memcpy((void*)ptr, (void*)last, h->item_size);
+    }
+}
+
+void
+array_assign(void* dest, const void* src)
+{
+    int added_count = array_len(src) - array_len(dest);
+    if (added_count >= 0) {
+        array_ensure_capacity(dest, added_count);
+    }
+
+    memcpy(dest, src, array_header(src)->item_size * array_len(src));
+    array_header(dest)->length = array_len(src);
+}
+
+void*
+array_copy(const void* original, Allocator* allocator)
+{
+    ArrayHeader original_header = *array_header(original);
+    size_t copy_size = original_header.item_size * original_header.length;
+    void* result     = array_init(sizeof(uint8_t), copy_size, allocator);
+    memcpy(result, original, copy_size);
+    ArrayHeader* result_header = array_header(result);
+    *result_header             = *array_header(original);
+
+    return result;
+}
+
+void*
+array_ensure_capacity(void* arr, size_t added_count)
+{
+    ArrayHeader* old_header = array_header(arr);
+
+    size_t desired_capacity = old_header->length + added_count;
+    if (desired_capacity <= old_header->capacity) {
+        return arr;
+    }
+
+    /* Realloc array */
+    size_t new_capacity = 2 * old_header->capacity;
+    if (new_capacity == 0)
+        new_capacity = 1;
+    while (new_capacity < desired_capacity) {
+        new_capacity *= 2;
+    }
+
+    size_t old_size =
+      sizeof(ArrayHeader) + old_header->capacity * old_header->item_size;
+    size_t new_size =
+      sizeof(ArrayHeader) + new_capacity * old_header->item_size;
+
+#ifdef CCORE_VERBOSE
+    /* printf(
+       "Reallocing array from %zu bytes to %zu bytes.\n", old_size,
+       new_size);
+     */
+#endif
+    ArrayHeader* new_header = old_header->allocator->realloc(
+      old_header, old_size, new_size, old_header->allocator->context);
+
+    if (new_header == NULL) {
+        return NULL;
+    }
+
+    new_header->capacity = new_capacity;
+    return new_header + 1;
+}
+
+char*
+cstr_from_dynstr(const char* src, Allocator* allocator)
+{
+    char* cstr = make(char, array_len(src) + 1, allocator);
+    memcpy(cstr, src, array_len(src));
+    cstr[array_len(src)] = '\0';
+    return cstr;
+}
+
+char*
+dynstr_from_cstr(const char* cstr, size_t capacity, Allocator* allocator)
+{
+    size_t len = strlen(cstr);
+
+    char* arr = array(char, capacity, allocator);
+    array_ensure_capacity(arr, len + 1);
+    memcpy(arr, cstr, len);
+    arr[len]                  = '\0';
+    array_header(arr)->length = len + 1;
+
+    return arr;
+}
+
+char*
+dynstr_init(size_t capacity, Allocator* a)
+{
+    char* arr = array(char, capacity, a);
+    array_append(arr, (u8)'\0');
+
+    return arr;
+}
+
+void
+dynstr_append(char* dest, const char* src)
+{
+    size_t src_len = strlen(src);
+    array_ensure_capacity(dest, src_len);
+    size_t dest_str_len = dynstr_len(dest);
+    array_header(dest)->length += src_len;
+    memcpy(&dest[dest_str_len], src, src_len);
+    dest[dynstr_len(dest)] = '\0';
+}
+
+void
+dynstr_set(char* dest, const char* src)
+{
+    size_t src_len = dynstr_len(src);
+    int diff       = src_len - dynstr_len(dest);
+    if (diff > 0) {
+        array_ensure_capacity(dest, diff);
+    }
+
+    memcpy(dest, src, src_len);
+    dest[src_len]              = '\0';
+    array_header(dest)->length = src_len + 1;
+}
+
+void
+dynstr_shrink(char* str, size_t amount)
+{
+    /* Clamp */
+    amount = (amount > dynstr_len(str) ? dynstr_len(str) : amount);
+    array_header(str)->length -= amount;
+    str[array_len(str) - 1] = '\0';
+}
+
+void
+dynstr_clear(char* str)
+{
+    array_header(str)->length = 1;
+    str[0]                    = '\0';
+}
+
+ByteString
+byte_string_from_cstr(const char* str)
+{
+    return (ByteString){ .ptr = str, .length = strlen(str) };
+}
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+/* From: https://benhoyt.com/writings/hash-table-in-c/
+   Return 64-bit FNV-1a hash for key (NUL-terminated). See
+   description:
+   https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function */
+uint64_t
+cstr_hash(const char* key)
+{
+    uint64_t hash = FNV_OFFSET;
+    const char* p = key;
+    for (p = key; *p; p++) {
+        hash ^= (uint64_t)(unsigned char)(*p);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t
+bytes_hash(const u8* key, size_t length)
+{
+    uint64_t hash = FNV_OFFSET;
+    size_t i      = 0;
+    for (i = 0; i < length; i++) {
+        hash ^= (uint64_t)(unsigned char)(key[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Bulk hash after wyhash (https://github.com/wangyi-fudan/wyhash): 64x64 to
+ * 128-bit multiplies folded with xor, consuming 48 bytes per loop step in
+ * three independent lanes. */
+static const uint64_t wyhash_secret[4] = { 0xa0761d6478bd642fULL,
+                                           0xe7037ed1a0b428dbULL,
+                                           0x8ebc6af09c88c6e3ULL,
+                                           0x589965cc75374cc3ULL };
+
+static uint64_t hash_seed = 0;
+
+static void
+wyhash_mum(uint64_t* a, uint64_t* b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)*a * *b;
+    *a                  = (uint64_t)product;
+    *b                  = (uint64_t)(product >> 64);
+#else
+    uint64_t a_hi = *a >> 32, a_lo = (uint32_t)*a;
+    uint64_t b_hi = *b >> 32, b_lo = (uint32_t)*b;
+    uint64_t hh = a_hi * b_hi, hl = a_hi * b_lo;
+    uint64_t lh = a_lo * b_hi, ll = a_lo * b_lo;
+    uint64_t t  = ll + (hl << 32);
+    uint64_t lo = t + (lh << 32);
+    uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (t < ll) + (lo < t);
+    *a          = lo;
+    *b          = hi;
+#endif
+}
+
+static uint64_t
+wyhash_mix(uint64_t a, uint64_t b)
+{
+    wyhash_mum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t
+wyhash_read8(const u8* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t
+wyhash_read4(const u8* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t
+bytes_hash_seeded(const u8* key, size_t length, uint64_t seed)
+{
+    const uint64_t* s = wyhash_secret;
+    const u8* p       = key;
+    uint64_t a, b;
+
+    seed ^= wyhash_mix(seed ^ s[0], s[1]);
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t shift = (length >> 3) << 2;
+            a = (wyhash_read4(p) << 32) | wyhash_read4(p + shift);
+            b = (wyhash_read4(p + length - 4) << 32) |
+                wyhash_read4(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) |
+                p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wyhash_mix(wyhash_read8(p) ^ s[1],
+                                  wyhash_read8(p + 8) ^ seed);
+                see1 = wyhash_mix(wyhash_read8(p + 16) ^ s[2],
+                                  wyhash_read8(p + 24) ^ see1);
+                see2 = wyhash_mix(wyhash_read8(p + 32) ^ s[3],
+                                  wyhash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed =
+              wyhash_mix(wyhash_read8(p) ^ s[1], wyhash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = wyhash_read8(p + i - 16);
+        b = wyhash_read8(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    wyhash_mum(&a, &b);
+    return wyhash_mix(a ^ s[0] ^ length, b ^ s[1]);
+}
+
+void
+hash_seed_set(uint64_t seed)
+{
+    hash_seed = seed;
+}
+
+uint64_t
+hash_seed_get(void)
+{
+    return hash_seed;
+}
+
+static void
+hashmap_records_clear(HashmapRecord* records, size_t capacity)
+{
+    memset(records, 0, sizeof(HashmapRecord) * capacity);
+}
+
+static void
+hashmap_free_old_records(Hashmap* hashmap)
+{
+    if (hashmap->old_records != NULL) {
+        hashmap->allocator->free(hashmap->old_records,
+                                 sizeof(HashmapRecord) * hashmap->old_capacity,
+                                 hashmap->allocator->context);
+        hashmap->old_records  = NULL;
+        hashmap->old_capacity = 0;
+        hashmap->migrated     = 0;
+    }
+}
+
+void
+hashmap_clear(Hashmap* hashmap)
+{
+    hashmap_records_clear(hashmap->records, hashmap->capacity);
+    hashmap_free_old_records(hashmap);
+    hashmap->length = 0;
+}
+
+/* Capacities are powers of two so probing can mask instead of dividing. */
+static size_t
+hashmap_round_capacity(size_t capacity)
+{
+    size_t result = 1;
+    while (result < capacity) {
+        result <<= 1;
+    }
+    return result;
+}
+
+void
+hashmap_init(Hashmap* hashmap,
+             uint64_t (*hash_fn)(const void*),
+             bool (*equals_fn)(const void*, const void*),
+             size_t capacity,
+             Allocator* allocator)
+{
+    capacity = hashmap_round_capacity(capacity);
+    hashmap->records =
+      allocator->alloc(sizeof(HashmapRecord) * capacity, allocator->context);
+    hashmap->capacity     = capacity;
+    hashmap->hash_fn      = hash_fn;
+    hashmap->equals_fn    = equals_fn;
+    hashmap->allocator    = allocator;
+    hashmap->max_load     = HASHMAP_DEFAULT_MAX_LOAD;
+    hashmap->old_records  = NULL;
+    hashmap->old_capacity = 0;
+    hashmap->migrated     = 0;
+    hashmap->seed         = hash_seed;
+    hashmap_clear(hashmap);
+}
+
+void
+hashmap_destroy(Hashmap* hashmap)
+{
+    hashmap_free_old_records(hashmap);
+    hashmap->allocator->free(hashmap->records,
+                             sizeof(HashmapRecord) * hashmap->capacity,
+                             hashmap->allocator->context);
+    hashmap->records  = NULL;
+    hashmap->capacity = 0;
+    hashmap->length   = 0;
+}
+
+static uint64_t
+byte_string_hash_with(const ByteString* b, uint64_t seed)
+{
+#ifdef CCORE_BYTE_STRING_HASH_FNV
+    (void)seed;
+    return bytes_hash((const u8*)b->ptr, b->length);
+#else
+    return bytes_hash_seeded((const u8*)b->ptr, b->length, seed);
+#endif
+}
+
+static uint64_t
+byte_string_hash(const void* byte_string)
+{
+    return byte_string_hash_with(byte_string, hash_seed);
+}
+
+/* Byte string maps hash with the seed captured by hashmap_init, so keys
+ * stored before a hash_seed_set are still found after it. */
+static uint64_t
+hashmap_hash(Hashmap* hashmap, const void* key)
+{
+    if (hashmap->hash_fn == byte_string_hash) {
+        return byte_string_hash_with(key, hashmap->seed);
+    }
+    return hashmap->hash_fn(key);
+}
+
+static bool
+byte_string_equal(const void* first, const void* second)
+{
+    ByteString a = *(ByteString*)first;
+    ByteString b = *(ByteString*)second;
+    return a.length == b.length && memcmp(a.ptr, b.ptr, a.length) == 0;
+}
+
+void
+hashmap_byte_string_init(Hashmap* hashmap,
+                         size_t capacity,
+                         Allocator* allocator)
+{
+    hashmap_init(
+      hashmap, byte_string_hash, byte_string_equal, capacity, allocator);
+}
+
+static HashmapRecord*
+hashmap_find(Hashmap* hashmap,
+             HashmapRecord* records,
+             size_t capacity,
+             const void* key,
+             uint64_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t idx  = (size_t)hash & mask;
+    size_t i    = 0;
+    for (i = 0; i < capacity; i++, idx = (idx + 1) & mask) {
+        HashmapRecord* record = &records[idx];
+        if (record->type == HASHMAP_RECORD_EMPTY) {
+            return NULL;
+        }
+        if (record->type == HASHMAP_RECORD_DELETED) {
+            continue;
+        }
+
+        if (record->hash == hash && hashmap->equals_fn(key, record->key)) {
+            return record;
+        }
+    }
+
+    return NULL;
+}
+
+/* Puts a key that is known not to be in the table in the first free slot
+ * of its probe sequence. */
+static void
+hashmap_place(HashmapRecord* records,
+              size_t capacity,
+              uint64_t hash,
+              void* key,
+              void* value)
+{
+    size_t mask = capacity - 1;
+    size_t idx  = (size_t)hash & mask;
+    while (records[idx].type == HASHMAP_RECORD_FILLED) {
+        idx = (idx + 1) & mask;
+    }
+    records[idx].hash  = hash;
+    records[idx].key   = key;
+    records[idx].value = value;
+    records[idx].type  = HASHMAP_RECORD_FILLED;
+}
+
+/* Moves up to count slots of the old table into the new one. Moved slots
+ * become tombstones so probe sequences through them stay intact for the
+ * keys that have not moved yet. */
+static void
+hashmap_migrate(Hashmap* hashmap, size_t count)
+{
+    while (hashmap->old_records != NULL && count-- > 0) {
+        HashmapRecord* record = &hashmap->old_records[hashmap->migrated++];
+        if (record->type == HASHMAP_RECORD_FILLED) {
+            hashmap_place(hashmap->records,
+                          hashmap->capacity,
+                          record->hash,
+                          record->key,
+                          record->value);
+            record->type = HASHMAP_RECORD_DELETED;
+        }
+        if (hashmap->migrated == hashmap->old_capacity) {
+            hashmap_free_old_records(hashmap);
+        }
+    }
+}
+
+/* Starts an incremental rehash into a table twice the size. A rehash that
+ * is still running is finished first. */
+static bool
+hashmap_grow(Hashmap* hashmap)
+{
+    size_t capacity = hashmap->capacity * 2;
+    HashmapRecord* records;
+
+    hashmap_migrate(hashmap, hashmap->old_capacity);
+    records = hashmap->allocator->alloc(sizeof(HashmapRecord) * capacity,
+                                        hashmap->allocator->context);
+    if (records == NULL) {
+        return false;
+    }
+    hashmap_records_clear(records, capacity);
+
+    hashmap->old_records  = hashmap->records;
+    hashmap->old_capacity = hashmap->capacity;
+    hashmap->migrated     = 0;
+    hashmap->records      = records;
+    hashmap->capacity     = capacity;
+    return true;
+}
+
+static int
+hashmap_insert_hashed(Hashmap* hashmap, void* key, void* value, uint64_t hash)
+{
+    hashmap_migrate(hashmap, HASHMAP_REHASH_STEP);
+
+    if (hashmap_find(
+          hashmap, hashmap->records, hashmap->capacity, key, hash) != NULL ||
+        (hashmap->old_records != NULL &&
+         hashmap_find(hashmap,
+                      hashmap->old_records,
+                      hashmap->old_capacity,
+                      key,
+                      hash) != NULL)) {
+        return 1;
+    }
+
+    if ((hashmap->length + 1) * 100 > hashmap->capacity * hashmap->max_load &&
+        !hashmap_grow(hashmap)) {
+        return 1;
+    }
+
+    hashmap_place(hashmap->records, hashmap->capacity, hash, key, value);
+    hashmap->length++;
+    return 0;
+}
+
+int
+hashmap_insert(Hashmap* hashmap, void* key, void* value)
+{
+    if (value == NULL)
+        return false;
+
+    return hashmap_insert_hashed(
+      hashmap, key, value, hashmap_hash(hashmap, key));
+}
+
+static void*
+hashmap_get_hashed(Hashmap* hashmap, const void* key, uint64_t hash)
+{
+    HashmapRecord* record =
+      hashmap_find(hashmap, hashmap->records, hashmap->capacity, key, hash);
+
+    if (record == NULL && hashmap->old_records != NULL) {
+        record = hashmap_find(
+          hashmap, hashmap->old_records, hashmap->old_capacity, key, hash);
+    }
+
+    return record != NULL ? record->value : NULL;
+}
+
+void*
+hashmap_get(Hashmap* hashmap, void* key)
+{
+    return hashmap_get_hashed(hashmap, key, hashmap_hash(hashmap, key));
+}
+
+static HashmapRecord*
+hashmap_find_byte_string(HashmapRecord* records,
+                         size_t capacity,
+                         ByteString* key,
+                         uint64_t hash)
+{
+    size_t mask = capacity - 1;
+    size_t idx  = (size_t)hash & mask;
+    size_t i    = 0;
+    for (i = 0; i < capacity; i++, idx = (idx + 1) & mask) {
+        HashmapRecord* record = &records[idx];
+        if (record->type == HASHMAP_RECORD_EMPTY) {
+            return NULL;
+        }
+        if (record->type == HASHMAP_RECORD_DELETED) {
+            continue;
+        }
+
+        if (record->hash == hash && byte_string_equal(key, record->key)) {
+            return record;
+        }
+    }
+
+    return NULL;
+}
+
+void*
+hashmap_byte_string_get(Hashmap* hashmap, ByteString key)
+{
+    uint64_t hash = byte_string_hash_with(&key, hashmap->seed);
+    HashmapRecord* record =
+      hashmap_find_byte_string(hashmap->records, hashmap->capacity, &key, hash);
+
+    if (record == NULL && hashmap->old_records != NULL) {
+        record = hashmap_find_byte_string(
+          hashmap->old_records, hashmap->old_capacity, &key, hash);
+    }
+
+    return record != NULL ? record->value : NULL;
+}
+
+/* Empties a slot of the live table and shifts the rest of its cluster back
+ * over the gap, so the table never holds tombstones and probe lengths do
+ * not grow under churn. An entry only moves if the gap lies between its
+ * home slot and where it currently sits. */
+static void
+hashmap_remove_shift(Hashmap* hashmap, size_t gap)
+{
+    HashmapRecord* records = hashmap->records;
+    size_t mask            = hashmap->capacity - 1;
+    size_t idx             = gap;
+
+    for (;;) {
+        size_t home;
+
+        idx = (idx + 1) & mask;
+        if (records[idx].type != HASHMAP_RECORD_FILLED) {
+            break;
+        }
+
+        home = (size_t)records[idx].hash & mask;
+        if (((idx - home) & mask) >= ((idx - gap) & mask)) {
+            records[gap] = records[idx];
+            gap          = idx;
+        }
+    }
+
+    records[gap].type  = HASHMAP_RECORD_EMPTY;
+    records[gap].key   = NULL;
+    records[gap].value = NULL;
+}
+
+static void*
+hashmap_delete_hashed(Hashmap* hashmap, const void* key, uint64_t hash)
+{
+    HashmapRecord* record;
+    void* value;
+
+    hashmap_migrate(hashmap, HASHMAP_REHASH_STEP);
+
+    record =
+      hashmap_find(hashmap, hashmap->records, hashmap->capacity, key, hash);
+    if (record == NULL && hashmap->old_records != NULL) {
+        record = hashmap_find(
+          hashmap, hashmap->old_records, hashmap->old_capacity, key, hash);
+    }
+    if (record == NULL) {
+        return NULL;
+    }
+
+    value = record->value;
+    if (record >= hashmap->records &&
+        record < hashmap->records + hashmap->capacity) {
+        hashmap_remove_shift(hashmap, (size_t)(record - hashmap->records));
+    } else {
+        /* The old table is drained in slot order, so shifting entries there
+         * could move one behind the migration cursor. */
+        record->type  = HASHMAP_RECORD_DELETED;
+        record->key   = NULL;
+        record->value = NULL;
+    }
+    hashmap->length--;
+    return value;
+}
+
+void*
+hashmap_delete(Hashmap* hashmap, void* key)
+{
+    return hashmap_delete_hashed(hashmap, key, hashmap_hash(hashmap, key));
+}
+
+/* Hashes up to HASHMAP_BATCH keys and prefetches their home slots in both
+ * tables, so the cache misses of the probes that follow overlap. */
+static size_t
+hashmap_prefetch_batch(Hashmap* hashmap,
+                       void** keys,
+                       size_t count,
+                       uint64_t* hashes)
+{
+    size_t i;
+
+    if (count > HASHMAP_BATCH) {
+        count = HASHMAP_BATCH;
+    }
+    for (i = 0; i < count; i++) {
+        hashes[i] = hashmap_hash(hashmap, keys[i]);
+        __builtin_prefetch(
+          &hashmap->records[hashes[i] & (hashmap->capacity - 1)]);
+        if (hashmap->old_records != NULL) {
+            __builtin_prefetch(
+              &hashmap->old_records[hashes[i] & (hashmap->old_capacity - 1)]);
+        }
+    }
+    return count;
+}
+
+void
+hashmap_get_batch(Hashmap* hashmap, void** keys, void** values, size_t count)
+{
+    uint64_t hashes[HASHMAP_BATCH];
+    size_t done = 0;
+
+    while (done < count) {
+        size_t batch = hashmap_prefetch_batch(
+          hashmap, keys + done, count - done, hashes);
+        size_t i;
+        for (i = 0; i < batch; i++) {
+            values[done + i] =
+              hashmap_get_hashed(hashmap, keys[done + i], hashes[i]);
+        }
+        done += batch;
+    }
+}
+
+size_t
+hashmap_insert_batch(Hashmap* hashmap,
+                     void** keys,
+                     void** values,
+                     size_t count)
+{
+    uint64_t hashes[HASHMAP_BATCH];
+    size_t inserted = 0;
+    size_t done     = 0;
+
+    while (done < count) {
+        size_t batch = hashmap_prefetch_batch(
+          hashmap, keys + done, count - done, hashes);
+        size_t i;
+        for (i = 0; i < batch; i++) {
+            if (values[done + i] != NULL &&
+                hashmap_insert_hashed(hashmap,
+                                      keys[done + i],
+                                      values[done + i],
+                                      hashes[i]) == 0) {
+                inserted++;
+            }
+        }
+        done += batch;
+    }
+    return inserted;
 }
 
-char*
-cstr_from_dynstr(const char* src, Allocator* allocator)
+size_t
+hashmap_len(Hashmap* hashmap)
 {
-    char* cstr = make(char, array_len(src) + 1, allocator);
-    memcpy(cstr, src, array_len(src));
-    cstr[array_len(src)] = '\0';
-    return cstr;
+    return hashmap->length;
 }
 
-char*
-dynstr_from_cstr(const char* cstr, size_t capacity, Allocator* allocator)
+/* Shards share the caller's allocator, which need not be thread safe, so
+ * their tables are allocated and freed under one lock. */
+static void*
+concurrent_hashmap_alloc_(size_t size, void* context)
 {
-    size_t len = strlen(cstr);
-
-    char* arr = array(char, capacity, allocator);
-    array_ensure_capacity(arr, len + 1);
-    memcpy(arr, cstr, len);
-    arr[len]                  = '\0';
-    array_header(arr)->length = len + 1;
+    ConcurrentHashmap* map = context;
+    void* ptr;
 
-    return arr;
+    spin_lock(&map->allocator_lock);
+    ptr = map->parent->alloc(size, map->parent->context);
+    spin_unlock(&map->allocator_lock);
+    return ptr;
 }
 
-char*
-dynstr_init(size_t capacity, Allocator* a)
+static void
+concurrent_hashmap_free_(void* ptr, size_t size, void* context)
 {
-    char* arr = array(char, capacity, a);
-    array_append(arr, (u8)'\0');
+    ConcurrentHashmap* map = context;
 
-    return arr;
+    spin_lock(&map->allocator_lock);
+    map->parent->free(ptr, size, map->parent->context);
+    spin_unlock(&map->allocator_lock);
+}
+
+static HashmapShard*
+concurrent_hashmap_shard(ConcurrentHashmap* map, uint64_t hash)
+{
+    return &map->shards[hash >> (64 - CONCURRENT_HASHMAP_SHARD_BITS)];
 }
 
 void
-dynstr_append(char* dest, const char* src)
+concurrent_hashmap_init(ConcurrentHashmap* map,
+                        uint64_t (*hash_fn)(const void*),
+                        bool (*equals_fn)(const void*, const void*),
+                        size_t capacity,
+                        Allocator* allocator)
 {
-    size_t src_len = strlen(src);
-    array_ensure_capacity(dest, src_len);
-    size_t dest_str_len = dynstr_len(dest);
-    array_header(dest)->length += src_len;
-    memcpy(&dest[dest_str_len], src, src_len);
-    dest[dynstr_len(dest)] = '\0';
+    size_t i;
+
+    map->parent         = allocator;
+    map->allocator_lock = 0;
+    map->allocator      = (Allocator){ .alloc   = concurrent_hashmap_alloc_,
+                                       .free    = concurrent_hashmap_free_,
+                                       .context = map };
+
+    capacity /= CONCURRENT_HASHMAP_SHARD_COUNT;
+    for (i = 0; i < CONCURRENT_HASHMAP_SHARD_COUNT; i++) {
+        map->shards[i].lock = 0;
+        hashmap_init(&map->shards[i].map,
+                     hash_fn,
+                     equals_fn,
+                     capacity < 8 ? 8 : capacity,
+                     &map->allocator);
+    }
 }
 
 void
-dynstr_set(char* dest, const char* src)
+concurrent_hashmap_destroy(ConcurrentHashmap* map)
 {
-    size_t src_len = dynstr_len(src);
-    int diff       = src_len - dynstr_len(dest);
-    if (diff > 0) {
-        array_ensure_capacity(dest, diff);
+    size_t i;
+    for (i = 0; i < CONCURRENT_HASHMAP_SHARD_COUNT; i++) {
+        hashmap_destroy(&map->shards[i].map);
     }
+}
 
-    memcpy(dest, src, src_len);
-    dest[src_len]              = '\0';
-    array_header(dest)->length = src_len + 1;
+int
+concurrent_hashmap_insert(ConcurrentHashmap* map, void* key, void* value)
+{
+    uint64_t hash;
+    HashmapShard* shard;
+    int result;
+
+    if (value == NULL)
+        return false;
+
+    hash  = hashmap_hash(&map->shards[0].map, key);
+    shard = concurrent_hashmap_shard(map, hash);
+    spin_write_lock(&shard->lock);
+    result = hashmap_insert_hashed(&shard->map, key, value, hash);
+    spin_write_unlock(&shard->lock);
+    return result;
 }
 
-void
-dynstr_shrink(char* str, size_t amount)
+void*
+concurrent_hashmap_get(ConcurrentHashmap* map, void* key)
 {
-    /* Clamp */
-    amount = (amount > dynstr_len(str) ? dynstr_len(str) : amount);
-    array_header(str)->length -= amount;
-    str[array_len(str) - 1] = '\0';
+    uint64_t hash       = hashmap_hash(&map->shards[0].map, key);
+    HashmapShard* shard = concurrent_hashmap_shard(map, hash);
+    void* value;
+
+    spin_read_lock(&shard->lock);
+    value = hashmap_get_hashed(&shard->map, key, hash);
+    spin_read_unlock(&shard->lock);
+    return value;
 }
 
-void
-dynstr_clear(char* str)
+void*
+concurrent_hashmap_delete(ConcurrentHashmap* map, void* key)
 {
-    array_header(str)->length = 1;
-    str[0]                    = '\0';
+    uint64_t hash       = hashmap_hash(&map->shards[0].map, key);
+    HashmapShard* shard = concurrent_hashmap_shard(map, hash);
+    void* value;
+
+    spin_write_lock(&shard->lock);
+    value = hashmap_delete_hashed(&shard->map, key, hash);
+    spin_write_unlock(&shard->lock);
+    return value;
 }
 
-ByteString
-byte_string_from_cstr(const char* str)
+/* Only a snapshot while other threads are writing. */
+size_t
+concurrent_hashmap_len(ConcurrentHashmap* map)
 {
-    return (ByteString){ .ptr = str, .length = strlen(str) };
+    size_t length = 0;
+    size_t i;
+    for (i = 0; i < CONCURRENT_HASHMAP_SHARD_COUNT; i++) {
+        length +=
+          __atomic_load_n(&map->shards[i].map.length, __ATOMIC_RELAXED);
+    }
+    return length;
 }
 
-#define FNV_OFFSET 14695981039346656037UL
-#define FNV_PRIME 1099511628211UL
+#define BYTE_STRING_MAP_EMPTY 0x80
+#define BYTE_STRING_MAP_DELETED 0xFE
 
-/* From: https://benhoyt.com/writings/hash-table-in-c/
-   Return 64-bit FNV-1a hash for key (NUL-terminated). See
-   description:
-   https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function */
-uint64_t
-cstr_hash(const char* key)
+/* Bit i of the result is set when control byte i of the group equals tag. */
+static unsigned
+byte_string_map_match(const u8* group, u8 tag)
 {
-    uint64_t hash = FNV_OFFSET;
-    const char* p = key;
-    for (p = key; *p; p++) {
-        hash ^= (uint64_t)(unsigned char)(*p);
-        hash *= FNV_PRIME;
+#ifdef __SSE2__
+    __m128i control = _mm_loadu_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(control, _mm_set1_epi8((char)tag)));
+#else
+    unsigned mask = 0;
+    size_t i;
+    for (i = 0; i < BYTE_STRING_MAP_GROUP; i++) {
+        mask |= (unsigned)(group[i] == tag) << i;
     }
-    return hash;
+    return mask;
+#endif
 }
 
-uint64_t
-bytes_hash(const u8* key, size_t length)
+static unsigned
+byte_string_map_lowest_bit(unsigned mask)
 {
-    uint64_t hash = FNV_OFFSET;
-    size_t i      = 0;
-    for (i = 0; i < length; i++) {
-        hash ^= (uint64_t)(unsigned char)(key[i]);
-        hash *= FNV_PRIME;
+    return (unsigned)__builtin_ctz(mask);
+}
+
+static bool
+byte_string_map_alloc(ByteStringMap* map, size_t capacity)
+{
+    size_t slots_size = sizeof(ByteStringMapSlot) * capacity;
+    void* memory      = map->allocator->alloc(slots_size + capacity,
+                                         map->allocator->context);
+    if (memory == NULL) {
+        return false;
     }
-    return hash;
+
+    map->slots      = memory;
+    map->control    = (u8*)memory + slots_size;
+    map->capacity   = capacity;
+    map->length     = 0;
+    map->tombstones = 0;
+    memset(map->control, BYTE_STRING_MAP_EMPTY, capacity);
+    return true;
 }
 
-void
-hashmap_clear(Hashmap* hashmap)
+static void
+byte_string_map_free(ByteStringMap* map)
 {
-    size_t i = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        hashmap->records[i].type  = HASHMAP_RECORD_EMPTY;
-        hashmap->records[i].key   = NULL;
-        hashmap->records[i].value = NULL;
+    if (map->slots == NULL) {
+        return;
     }
-    hashmap->length = 0;
+    map->allocator->free(map->slots,
+                         (sizeof(ByteStringMapSlot) + 1) * map->capacity,
+                         map->allocator->context);
+}
+
+int
+byte_string_map_init(ByteStringMap* map, size_t capacity, Allocator* allocator)
+{
+    capacity = hashmap_round_capacity(capacity);
+    if (capacity < BYTE_STRING_MAP_GROUP) {
+        capacity = BYTE_STRING_MAP_GROUP;
+    }
+    map->allocator  = allocator;
+    map->slots      = NULL;
+    map->control    = NULL;
+    map->capacity   = 0;
+    map->length     = 0;
+    map->tombstones = 0;
+    map->seed       = hash_seed;
+    return byte_string_map_alloc(map, capacity) ? 0 : 1;
 }
 
 void
-hashmap_init(Hashmap* hashmap,
-             uint64_t (*hash_fn)(const void*),
-             bool (*equals_fn)(const void*, const void*),
-             size_t capacity,
-             Allocator* allocator)
+byte_string_map_destroy(ByteStringMap* map)
 {
-    hashmap->records =
-      allocator->alloc(sizeof(HashmapRecord) * capacity, allocator->context);
-    hashmap->capacity  = capacity;
-    hashmap->length    = 0;
-    hashmap->hash_fn   = hash_fn;
-    hashmap->equals_fn = equals_fn;
-    size_t i           = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        hashmap->records[i].type  = HASHMAP_RECORD_EMPTY;
-        hashmap->records[i].key   = NULL;
-        hashmap->records[i].value = NULL;
+    byte_string_map_free(map);
+    map->slots    = NULL;
+    map->control  = NULL;
+    map->capacity = 0;
+    map->length   = 0;
+}
+
+/* The low 7 bits of the hash become the control tag, the rest picks the
+ * first group. Groups are probed triangularly, which visits every group
+ * when their count is a power of two. */
+static ByteStringMapSlot*
+byte_string_map_find(ByteStringMap* map, ByteString key, uint64_t hash)
+{
+    size_t group_mask = map->capacity / BYTE_STRING_MAP_GROUP - 1;
+    size_t group      = (size_t)(hash >> 7) & group_mask;
+    u8 tag            = (u8)(hash & 0x7F);
+    size_t step;
+
+    if (map->capacity == 0) {
+        return NULL;
+    }
+    for (step = 1; step <= group_mask + 1; step++) {
+        const u8* control = &map->control[group * BYTE_STRING_MAP_GROUP];
+        unsigned matches  = byte_string_map_match(control, tag);
+
+        while (matches != 0) {
+            ByteStringMapSlot* slot =
+              &map->slots[group * BYTE_STRING_MAP_GROUP +
+                          byte_string_map_lowest_bit(matches)];
+            if (slot->key.length == key.length &&
+                memcmp(slot->key.ptr, key.ptr, key.length) == 0) {
+                return slot;
+            }
+            matches &= matches - 1;
+        }
+
+        if (byte_string_map_match(control, BYTE_STRING_MAP_EMPTY) != 0) {
+            return NULL;
+        }
+        group = (group + step) & group_mask;
+    }
+
+    return NULL;
+}
+
+/* Index of the first empty or deleted slot in the probe sequence. */
+static size_t
+byte_string_map_find_free(ByteStringMap* map, uint64_t hash)
+{
+    size_t group_mask = map->capacity / BYTE_STRING_MAP_GROUP - 1;
+    size_t group      = (size_t)(hash >> 7) & group_mask;
+    size_t step;
+
+    for (step = 1;; step++) {
+        const u8* control = &map->control[group * BYTE_STRING_MAP_GROUP];
+        unsigned free     = byte_string_map_match(control,
+                                              BYTE_STRING_MAP_EMPTY) |
+                        byte_string_map_match(control, BYTE_STRING_MAP_DELETED);
+        if (free != 0) {
+            return group * BYTE_STRING_MAP_GROUP +
+                   byte_string_map_lowest_bit(free);
+        }
+        group = (group + step) & group_mask;
     }
 }
 
-static uint64_t
-byte_string_hash(const void* byte_string)
+static void
+byte_string_map_place(ByteStringMap* map,
+                      ByteString key,
+                      void* value,
+                      uint64_t hash)
 {
-    ByteString b = *(ByteString*)byte_string;
-    return bytes_hash((const u8*)b.ptr, b.length);
+    size_t idx = byte_string_map_find_free(map, hash);
+
+    if (map->control[idx] == BYTE_STRING_MAP_DELETED) {
+        map->tombstones--;
+    }
+    map->control[idx]     = (u8)(hash & 0x7F);
+    map->slots[idx].key   = key;
+    map->slots[idx].value = value;
+    map->length++;
 }
 
+/* Rebuilds the table, doubling it unless most of the load was tombstones. */
 static bool
-byte_string_equal(const void* first, const void* second)
+byte_string_map_rehash(ByteStringMap* map)
 {
-    ByteString a = *(ByteString*)first;
-    ByteString b = *(ByteString*)second;
-    return a.length == b.length && memcmp(a.ptr, b.ptr, a.length) == 0;
+    ByteStringMap old = *map;
+    size_t capacity   = map->capacity;
+    size_t i;
+
+    if (map->length * 2 >= map->capacity * 7 / 8) {
+        capacity *= 2;
+    }
+    if (capacity < BYTE_STRING_MAP_GROUP) {
+        capacity = BYTE_STRING_MAP_GROUP;
+    }
+    if (!byte_string_map_alloc(map, capacity)) {
+        *map = old;
+        return false;
+    }
+
+    for (i = 0; i < old.capacity; i++) {
+        if (old.control[i] < BYTE_STRING_MAP_EMPTY) {
+            byte_string_map_place(map,
+                                  old.slots[i].key,
+                                  old.slots[i].value,
+                                  byte_string_hash_with(&old.slots[i].key,
+                                                        map->seed));
+        }
+    }
+    byte_string_map_free(&old);
+    return true;
 }
 
-void
-hashmap_byte_string_init(Hashmap* hashmap,
-                         size_t capacity,
-                         Allocator* allocator)
+int
+byte_string_map_insert(ByteStringMap* map, ByteString key, void* value)
 {
-    hashmap->records =
-      allocator->alloc(sizeof(HashmapRecord) * capacity, allocator->context);
-    hashmap->capacity  = capacity;
-    hashmap->length    = 0;
-    hashmap->hash_fn   = byte_string_hash;
-    hashmap->equals_fn = byte_string_equal;
-    size_t i           = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        hashmap->records[i].type  = HASHMAP_RECORD_EMPTY;
-        hashmap->records[i].key   = NULL;
-        hashmap->records[i].value = NULL;
+    uint64_t hash = byte_string_hash_with(&key, map->seed);
+
+    if (byte_string_map_find(map, key, hash) != NULL) {
+        return 1;
+    }
+    if ((map->length + map->tombstones + 1) * 8 > map->capacity * 7 &&
+        !byte_string_map_rehash(map)) {
+        return 1;
     }
+
+    byte_string_map_place(map, key, value, hash);
+    return 0;
 }
 
-int
-hashmap_insert(Hashmap* hashmap, void* key, void* value)
+void*
+byte_string_map_get(ByteStringMap* map, ByteString key)
 {
-    if (value == NULL)
-        return false;
+    ByteStringMapSlot* slot =
+      byte_string_map_find(map, key, byte_string_hash_with(&key, map->seed));
+    return slot != NULL ? slot->value : NULL;
+}
+
+/* A probe stops at the first group with an empty slot, so a slot in such a
+ * group can be emptied outright instead of leaving a tombstone. */
+void*
+byte_string_map_delete(ByteStringMap* map, ByteString key)
+{
+    ByteStringMapSlot* slot =
+      byte_string_map_find(map, key, byte_string_hash_with(&key, map->seed));
+    size_t idx;
+    void* value;
+
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    idx   = (size_t)(slot - map->slots);
+    value = slot->value;
+    if (byte_string_map_match(
+          &map->control[idx & ~(size_t)(BYTE_STRING_MAP_GROUP - 1)],
+          BYTE_STRING_MAP_EMPTY) != 0) {
+        map->control[idx] = BYTE_STRING_MAP_EMPTY;
+    } else {
+        map->control[idx] = BYTE_STRING_MAP_DELETED;
+        map->tombstones++;
+    }
+    map->length--;
+    return value;
+}
+
+size_t
+byte_string_map_len(ByteStringMap* map)
+{
+    return map->length;
+}
+
+#define INTERNER_EMPTY 0
+
+static InternEntry*
+interner_entries(Interner* interner)
+{
+    return (InternEntry*)interner->entries.base;
+}
 
-    u16 idx  = hashmap->hash_fn(key) % hashmap->capacity;
-    size_t i = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        HashmapRecord* record =
-          &hashmap->records[(idx + i) % hashmap->capacity];
-
-        if (record->type == HASHMAP_RECORD_EMPTY ||
-            record->type == HASHMAP_RECORD_DELETED) {
-            record->key   = key;
-            record->value = value;
-            record->type  = HASHMAP_RECORD_FILLED;
-            hashmap->length++;
+int
+interner_init(Interner* interner, size_t reserve, Allocator* allocator)
+{
+    interner->allocator = allocator;
+    interner->seed      = hash_seed;
+    interner->count     = 0;
+    interner->capacity  = INTERNER_MIN_CAPACITY;
+    interner->table     = allocator->alloc(sizeof(u32) * interner->capacity,
+                                       allocator->context);
+    if (interner->table == NULL) {
+        return 1;
+    }
+    memset(interner->table, 0, sizeof(u32) * interner->capacity);
+
+    /* Entries are indexed by id, so pushes must not pad between them. */
+    assert(sizeof(InternEntry) % DEFAULT_ALIGNMENT == 0);
+    if (varena_init_ex(&interner->bytes, reserve, system_page_size(), 1) ==
+        0) {
+        if (varena_init_ex(&interner->entries,
+                           reserve,
+                           system_page_size(),
+                           DEFAULT_ALIGNMENT) == 0) {
             return 0;
-        } else if (record->type == HASHMAP_RECORD_FILLED &&
-                   hashmap->equals_fn(record->key, key)) {
-            return 1;
         }
+        varena_destroy(&interner->bytes);
     }
 
+    allocator->free(interner->table,
+                    sizeof(u32) * interner->capacity,
+                    allocator->context);
+    interner->table = NULL;
     return 1;
 }
 
-void*
-hashmap_get(Hashmap* hashmap, void* key)
+void
+interner_destroy(Interner* interner)
 {
-    u16 hash = hashmap->hash_fn(key) % hashmap->capacity;
-    size_t i = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        u16 idx               = (hash + i) % hashmap->capacity;
-        HashmapRecord* record = &hashmap->records[idx];
-        if (record->type == HASHMAP_RECORD_EMPTY) {
-            return NULL;
+    interner->allocator->free(interner->table,
+                              sizeof(u32) * interner->capacity,
+                              interner->allocator->context);
+    varena_destroy(&interner->bytes);
+    varena_destroy(&interner->entries);
+    interner->table    = NULL;
+    interner->capacity = 0;
+    interner->count    = 0;
+}
+
+/* Returns the table slot holding the string, or the empty slot where it
+ * would go. Slots hold id + 1 so that zeroed memory is an empty table. */
+static u32*
+interner_slot(Interner* interner, const char* ptr, size_t length, u32 hash)
+{
+    InternEntry* entries = interner_entries(interner);
+    size_t mask          = interner->capacity - 1;
+    size_t idx           = hash & mask;
+
+    for (;; idx = (idx + 1) & mask) {
+        u32* slot = &interner->table[idx];
+        InternEntry* entry;
+
+        if (*slot == INTERNER_EMPTY) {
+            return slot;
         }
-        if (record->type == HASHMAP_RECORD_DELETED) {
-            continue;
+        entry = &entries[*slot - 1];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp((u8*)interner->bytes.base + entry->offset, ptr, length) ==
+              0) {
+            return slot;
         }
+    }
+}
+
+static bool
+interner_grow(Interner* interner)
+{
+    InternEntry* entries = interner_entries(interner);
+    size_t capacity      = interner->capacity * 2;
+    u32* table = interner->allocator->alloc(sizeof(u32) * capacity,
+                                            interner->allocator->context);
+    u32 id;
+
+    if (table == NULL) {
+        return false;
+    }
+    memset(table, 0, sizeof(u32) * capacity);
 
-        if (hashmap->equals_fn(key, record->key)) {
-            return record->value;
+    /* Ids are unique, so each one goes straight to the first empty slot. */
+    for (id = 0; id < interner->count; id++) {
+        size_t idx = entries[id].hash & (capacity - 1);
+        while (table[idx] != INTERNER_EMPTY) {
+            idx = (idx + 1) & (capacity - 1);
         }
+        table[idx] = id + 1;
     }
 
-    return NULL;
+    interner->allocator->free(interner->table,
+                              sizeof(u32) * interner->capacity,
+                              interner->allocator->context);
+    interner->table    = table;
+    interner->capacity = capacity;
+    return true;
 }
 
-void*
-hashmap_byte_string_get(Hashmap* hashmap, ByteString key)
+u32
+interner_intern(Interner* interner, ByteString string)
 {
-    u16 hash = byte_string_hash(&key) % hashmap->capacity;
-    size_t i = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        u16 idx               = (hash + i) % hashmap->capacity;
-        HashmapRecord* record = &hashmap->records[idx];
-        if (record->type == HASHMAP_RECORD_EMPTY) {
-            return NULL;
-        }
-        if (record->type == HASHMAP_RECORD_DELETED) {
-            continue;
-        }
+    u32 hash;
+    u32* slot;
+    InternEntry* entry;
+
+    if (string.length > UINT32_MAX) {
+        return INTERNER_INVALID_ID;
+    }
+    hash = (u32)bytes_hash_seeded(
+      (const u8*)string.ptr, string.length, interner->seed);
+    slot = interner_slot(interner, string.ptr, string.length, hash);
 
-        if (byte_string_equal(&key, record->key)) {
-            return record->value;
+    if (*slot != INTERNER_EMPTY) {
+        return *slot - 1;
+    }
+
+    if (interner->count == INTERNER_INVALID_ID ||
+        !varena_fits(&interner->entries, sizeof(InternEntry)) ||
+        !varena_fits(&interner->bytes, string.length)) {
+        return INTERNER_INVALID_ID;
+    }
+
+    if ((interner->count + 1) * 100 >
+        interner->capacity * HASHMAP_DEFAULT_MAX_LOAD) {
+        if (!interner_grow(interner)) {
+            return INTERNER_INVALID_ID;
         }
+        slot = interner_slot(interner, string.ptr, string.length, hash);
     }
 
-    return NULL;
+    entry         = varena_push(&interner->entries, sizeof(InternEntry));
+    entry->offset = interner->bytes.used;
+    entry->length = (u32)string.length;
+    entry->hash   = hash;
+    varena_push_copy(&interner->bytes, string.ptr, string.length);
+
+    *slot = ++interner->count;
+    return *slot - 1;
 }
 
-void*
-hashmap_delete(Hashmap* hashmap, void* key)
+bool
+interner_find(Interner* interner, ByteString string, u32* id)
 {
-    u16 hash = hashmap->hash_fn(key) % hashmap->capacity;
-    size_t i = 0;
-    for (i = 0; i < hashmap->capacity; i++) {
-        u16 idx               = (hash + i) % hashmap->capacity;
-        HashmapRecord* record = &hashmap->records[idx];
-        if (record->type == HASHMAP_RECORD_EMPTY) {
-            return NULL;
-        }
-        if (record->type == HASHMAP_RECORD_DELETED) {
-            continue;
-        }
+    u32 hash = (u32)bytes_hash_seeded(
+      (const u8*)string.ptr, string.length, interner->seed);
+    u32* slot = interner_slot(interner, string.ptr, string.length, hash);
 
-        if (hashmap->equals_fn(key, record->key)) {
-            void* temp    = record->value;
-            record->type  = HASHMAP_RECORD_DELETED;
-            record->key   = NULL;
-            record->value = NULL;
-            return temp;
-        }
+    if (*slot == INTERNER_EMPTY) {
+        return false;
     }
+    *id = *slot - 1;
+    return true;
+}
 
-    return NULL;
+ByteString
+interner_lookup(Interner* interner, u32 id)
+{
+    InternEntry* entry = &interner_entries(interner)[id];
+    ByteString string;
+
+    assert(id < interner->count);
+    string.ptr    = (const char*)interner->bytes.base + (size_t)entry->offset;
+    string.length = entry->length;
+    return string;
+}
+
+u32
+interner_count(Interner* interner)
+{
+    return interner->count;
 }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -15,16 +16,27 @@
 typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 #define KILOBYTE (1024ULL)
 #define MEGABYTE (1024ULL * 1024ULL)
 
 #define DEFAULT_ALIGNMENT (2 * sizeof(void*))
 
+/* Placed after `struct` to start every instance on its own cache line.
+ * The concurrent allocators and maps use GCC builtins (__atomic_*,
+ * __builtin_ctz, ...), so only GCC and Clang are supported. */
+#define CCORE_CACHE_LINE 64
+#ifdef __GNUC__
+#define CCORE_CACHE_ALIGN __attribute__((aligned(CCORE_CACHE_LINE)))
+#else
+#define CCORE_CACHE_ALIGN
+#endif
+
 #define make(T, n, a) ((T*)((a)->alloc(sizeof(T) * (n), (a)->context)))
 
 #define arena_push_array(arena, type, length)                                  \
-    (type*)arena_push(arena, sizeof(type) * length)
+    (type*)arena_allocate(arena, sizeof(type) * (length))
 
 #define array(type, cap, alloc) array_init(sizeof(type), cap, alloc)
 #define array_append(a, v)                                                     \
@@ -54,22 +66,86 @@ typedef struct
     void* context;
 } Allocator;
 
+/* Extra blocks of a chained arena start with this header. */
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock
+{
+    ArenaBlock* next;
+    size_t size;
+};
+
+#define ARENA_MIN_BLOCK_SIZE (4 * KILOBYTE)
+
+/* base, used and size describe the block being filled. A fixed arena has a
+ * single block and no parent. A chained arena takes further blocks from
+ * parent when the current one fills up, each at least twice the size of the
+ * last; arena_clear keeps them for reuse and arena_destroy frees them. */
 typedef struct
 {
     void* base;
     size_t used;
     size_t size;
     size_t alignment;
+    Allocator* parent;
+    void* first_base;
+    size_t first_size;
+    ArenaBlock* blocks;
+    ArenaBlock* current;
 } Arena;
 
+/* A position in an Arena to rewind to, dropping everything pushed since. */
+typedef struct
+{
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+/* Options for varena_init_flags. Huge page options raise page_size to a
+ * multiple of VARENA_HUGE_PAGE_SIZE so every commit covers whole huge
+ * pages. VARENA_HUGETLB falls back to VARENA_HUGE_PAGES behaviour when the
+ * explicit pool cannot back the whole reservation. VARENA_PREFAULT faults
+ * pages in when they are committed, and VARENA_GEOMETRIC commits at least
+ * as many pages as are already committed, so commits double. */
+#define VARENA_HUGE_PAGES (1u << 0)
+#define VARENA_HUGETLB (1u << 1)
+#define VARENA_PREFAULT (1u << 2)
+#define VARENA_GEOMETRIC (1u << 3)
+
+#define VARENA_HUGE_PAGE_SIZE (2 * MEGABYTE)
+
+/* varena_clear keeps max(retain, high_water) bytes committed. high_water
+ * follows the peak usage of each cycle between clears and otherwise decays
+ * by 1/2^VARENA_HIGH_WATER_DECAY per clear. Pages are only given back once
+ * the committed size is more than twice what would be kept, so request
+ * sizes that vary do not cause a commit and decommit every cycle. */
+#define VARENA_DEFAULT_RETAIN (1 * MEGABYTE)
+#define VARENA_HIGH_WATER_DECAY 3
+
+/* Define CCORE_VARENA_PAD_USED, for the library and everything including
+ * this header alike, when arenas are shared through varena_push_atomic. It
+ * pads used onto a cache line of its own, so the fetch-add on every push
+ * does not invalidate page_count and the other fields each push reads. It
+ * is off by default because it makes every VArena two cache lines larger,
+ * including the ones that are never shared. */
 typedef struct
 {
     void* base;
     size_t page_size;
     size_t page_count;
-    size_t used;
     size_t size;
     size_t alignment;
+    unsigned flags;
+    size_t retain;
+    size_t high_water;
+    size_t peak;
+    int commit_lock;
+#ifdef CCORE_VARENA_PAD_USED
+    char used_pad_before_[CCORE_CACHE_LINE - sizeof(size_t)];
+#endif
+    size_t used;
+#ifdef CCORE_VARENA_PAD_USED
+    char used_pad_after_[CCORE_CACHE_LINE - sizeof(size_t)];
+#endif
 } VArena;
 
 typedef struct
@@ -86,25 +162,128 @@ struct PoolFreeNode
     PoolFreeNode* next;
 };
 
+/* Growable pools commit their reservation one slab at a time. */
+#define POOL_SLAB_SIZE (64 * KILOBYTE)
+#define POOL_SLAB_MIN_CHUNKS 16
+#define POOL_SLAB_DECOMMITTED UINT32_MAX
+
+/* Chunks are laid out in slabs of slab_size bytes, a fixed pool being a
+ * single slab. Freed chunks go on the head list, chunks from bump up to
+ * bump_limit (offsets from base) have never been handed out, so memory is
+ * only touched once it is used. pool_allocate only zeroes chunks when
+ * zero_chunks is set. Pools created with pool_init_virtual have a
+ * reservation and a slabs table that pool_trim uses to track released
+ * slabs. */
 typedef struct
 {
     u8* base;
     size_t capacity;
     size_t chunk_size;
     PoolFreeNode* head;
+    bool zero_chunks;
+    size_t bump;
+    size_t bump_limit;
+    void* reservation;
+    size_t reserved;
+    size_t slab_size;
+    u32* slabs;
+    size_t decommitted;
 } Pool;
 
+/* One free list per power-of-two order, order 0 being the smallest block. */
+#define BUDDY_ORDER_COUNT (sizeof(size_t) * 8)
+
+#define POOL_MAGAZINE_SIZE 32
+
+typedef struct PoolMagazine PoolMagazine;
+struct PoolMagazine
+{
+    PoolMagazine* next;
+    size_t count;
+    void* rounds[POOL_MAGAZINE_SIZE];
+};
+
+/* Shared by all threads. Keeps a stack of full magazines and one of empty
+ * magazines, and lock only guards the O(1) swap of a cache's magazine for
+ * one of these. The pool is only touched, under pool_lock, when there is no
+ * full magazine left or when a cache is flushed. Magazines are allocated
+ * from allocator. */
+typedef struct
+{
+    Pool* pool;
+    Allocator* allocator;
+    PoolMagazine* full;
+    PoolMagazine* empty;
+    int lock;
+    int pool_lock;
+} PoolDepot;
+
+/* Owned by a single thread. Allocation and free only touch the two
+ * magazines until both are empty or both are full. Chunks are not zeroed. */
+typedef struct
+{
+    PoolDepot* depot;
+    PoolMagazine* loaded;
+    PoolMagazine* previous;
+} PoolCache;
+
+/* Pool variant that can be shared between threads. Free chunks form a
+ * Treiber stack; head packs a generation counter in its upper 32 bits with
+ * the top chunk's index + 1 in its lower 32 bits (0 means empty), so a
+ * chunk that is popped and pushed back between a load and a CAS is seen as
+ * a different head. */
+typedef struct
+{
+    u8* base;
+    size_t capacity;
+    size_t chunk_size;
+    bool zero_chunks;
+    uint64_t head;
+} ConcurrentPool;
+
+/* Size classes step by 16 bytes up to 128, then by a quarter of the
+ * previous power of two up to SLAB_MAX_SIZE. */
+#define SLAB_CLASS_COUNT 24
+#define SLAB_MAX_SIZE 2048
+
+/* One growable Pool per size class. Requests above SLAB_MAX_SIZE go to the
+ * fallback allocator, if any. */
+typedef struct
+{
+    Pool pools[SLAB_CLASS_COUNT];
+    u8 class_of[SLAB_MAX_SIZE / 16 + 1];
+    Allocator* fallback;
+} SlabAllocator;
+
 typedef struct BuddyBlock
 {
     size_t size;
     bool is_free;
 } BuddyBlock;
 
+/* Links of a free block, stored in the block's payload. */
+typedef struct BuddyFreeNode BuddyFreeNode;
+struct BuddyFreeNode
+{
+    BuddyFreeNode* prev;
+    BuddyFreeNode* next;
+};
+
+/* Blocks carry an inline BuddyBlock header unless the allocator was created
+ * with buddy_allocator_init_bitmap, in which case header_size is 0 and the
+ * split/free state of every tree node lives in the two bitmaps. */
 typedef struct BuddyAllocator
 {
     BuddyBlock* head;
     BuddyBlock* tail;
     size_t alignment;
+    size_t header_size;
+    size_t min_block_size;
+    size_t min_block_shift;
+    size_t order_count;
+    uint64_t* split_bits;
+    uint64_t* free_bits;
+    BuddyFreeNode* free_lists[BUDDY_ORDER_COUNT];
 } BuddyAllocator;
 
 void
@@ -114,24 +293,120 @@ pool_init(Pool* pool,
           size_t chunk_size,
           size_t chunk_alignment);
 
+int
+pool_init_virtual(Pool* pool,
+                  size_t reserve,
+                  size_t chunk_size,
+                  size_t chunk_alignment);
+
+void
+pool_destroy(Pool* pool);
+
+size_t
+pool_trim(Pool* p);
+
 void
 pool_free_all(Pool* p);
 
 void*
 pool_allocate(Pool* p);
 
+void*
+pool_allocate_uninit(Pool* p);
+
+size_t
+pool_allocate_n(Pool* p, void** chunks, size_t count);
+
+void
+pool_free_n(Pool* p, void** chunks, size_t count);
+
 void
 pool_free(Pool* p, void* ptr);
 
 Allocator
 pool_allocator(Pool* pool);
 
+int
+slab_allocator_init(SlabAllocator* slab,
+                    size_t reserve_per_class,
+                    Allocator* fallback);
+
+void
+slab_allocator_destroy(SlabAllocator* slab);
+
+void*
+slab_allocate(SlabAllocator* slab, size_t size);
+
+void
+slab_free(SlabAllocator* slab, void* ptr, size_t size);
+
+Allocator
+slab_allocator(SlabAllocator* slab);
+
+void
+pool_depot_init(PoolDepot* depot, Pool* pool, Allocator* allocator);
+
+/* Returns the chunks of every full magazine to the pool and frees the
+ * magazines. All caches must have been flushed. */
+void
+pool_depot_destroy(PoolDepot* depot);
+
+/* Returns nonzero if the cache's two magazines could not be allocated. */
+int
+pool_cache_init(PoolCache* cache, PoolDepot* depot);
+
+void*
+pool_cache_allocate(PoolCache* cache);
+
+void
+pool_cache_free(PoolCache* cache, void* ptr);
+
+void
+pool_cache_flush(PoolCache* cache);
+
+Allocator
+pool_cache_allocator(PoolCache* cache);
+
+void
+concurrent_pool_init(ConcurrentPool* pool,
+                     void* base,
+                     size_t capacity,
+                     size_t chunk_size,
+                     size_t chunk_alignment);
+
+void*
+concurrent_pool_allocate(ConcurrentPool* pool);
+
+void
+concurrent_pool_free(ConcurrentPool* pool, void* ptr);
+
+Allocator
+concurrent_pool_allocator(ConcurrentPool* pool);
+
 void
 buddy_allocator_init(BuddyAllocator* b,
                      void* data,
                      size_t size,
                      size_t alignment);
 
+size_t
+buddy_allocator_metadata_size(size_t size, size_t min_block_size);
+
+void
+buddy_allocator_init_bitmap(BuddyAllocator* b,
+                            void* data,
+                            size_t size,
+                            size_t min_block_size,
+                            void* metadata);
+
+size_t
+buddy_allocator_block_size(BuddyAllocator* b, const void* data);
+
+/* Grows or shrinks an allocated block in place. Returns false, leaving the
+ * block untouched, when growing would need a buddy that is not free. */
+bool
+buddy_allocator_resize(BuddyAllocator* b, void* data, size_t size);
+
 void
 buddy_allocator_free(BuddyAllocator* b, void* data);
 
@@ -153,6 +428,21 @@ arena_clear(Arena* arena);
 void
 arena_init_ex(Arena* arena, void* base, size_t size, size_t alignment);
 
+/* base may be NULL with a size of 0, in which case the first push takes a
+ * block from parent. */
+void
+arena_init_chained(Arena* arena, void* base, size_t size, Allocator* parent);
+
+void
+arena_destroy(Arena* arena);
+
+ArenaMark
+arena_mark(Arena* arena);
+
+/* Chained blocks past the mark are kept for reuse, as with arena_clear. */
+void
+arena_rewind(Arena* arena, ArenaMark mark);
+
 void*
 arena_allocate(Arena* arena, size_t size);
 
@@ -168,12 +458,31 @@ varena_init(VArena* arena, size_t size);
 void
 varena_clear(VArena* varena);
 
+/* SIZE_MAX keeps everything committed, as before decommit-on-clear. */
+void
+varena_set_retain(VArena* varena, size_t retain);
+
 int
 varena_init_ex(VArena* arena, size_t size, size_t page_size, size_t alignment);
 
+int
+varena_init_flags(VArena* arena,
+                  size_t size,
+                  size_t page_size,
+                  size_t alignment,
+                  unsigned flags);
+
 void*
 varena_push(VArena* varena, size_t size);
 
+/* Thread-safe push: claims its range with one atomic add on used, and only
+ * takes a lock when the range reaches past the committed pages. Sizes are
+ * rounded up to the alignment so ranges stay aligned; do not mix it with
+ * varena_push, which can leave used unaligned. Returns NULL once the
+ * reservation is exhausted. */
+void*
+varena_push_atomic(VArena* varena, size_t size);
+
 void
 varena_push_copy(VArena* arena, const void* data, size_t size);
 
@@ -183,6 +492,37 @@ varena_destroy(VArena* arena);
 Allocator
 varena_allocator(VArena* varena);
 
+size_t
+varena_mark(VArena* varena);
+
+void
+varena_rewind(VArena* varena, size_t mark);
+
+/* Per-thread scratch VArenas for temporary memory. scratch_begin returns one
+ * that is not among the conflicts, which are arenas the caller is already
+ * allocating from, such as one its own caller passed in. Everything pushed
+ * to it is dropped by scratch_end. The arena is NULL if reserving it
+ * failed. scratch_release frees the calling thread's scratch arenas. */
+#define SCRATCH_ARENA_COUNT 2
+#define SCRATCH_ARENA_RESERVE (256 * MEGABYTE)
+
+#define CCORE_THREAD_LOCAL __thread
+
+typedef struct
+{
+    VArena* arena;
+    size_t mark;
+} ScratchArena;
+
+ScratchArena
+scratch_begin(VArena** conflicts, size_t conflict_count);
+
+void
+scratch_end(ScratchArena scratch);
+
+void
+scratch_release(void);
+
 void*
 array_init(size_t item_size, size_t capacity, Allocator* allocator);
 
@@ -237,20 +577,37 @@ byte_string_from_cstr(const char* str);
 bool
 byte_string_equals(ByteString first, ByteString second);
 
+/* EMPTY is zero so a table can be cleared with a single memset. */
 typedef enum
 {
-    HASHMAP_RECORD_FILLED,
     HASHMAP_RECORD_EMPTY,
+    HASHMAP_RECORD_FILLED,
     HASHMAP_RECORD_DELETED
 } HashmapRecordType;
 
+/* The full hash is kept with each record: probes compare it before calling
+ * equals_fn, and rehashing and deletion reuse it instead of rehashing keys. */
 typedef struct
 {
     HashmapRecordType type;
+    uint64_t hash;
     void* key;
     void* value;
 } HashmapRecord;
 
+/* Percentage of filled slots that triggers growth, and how many old slots
+ * each insert or delete moves while a rehash is running. */
+#define HASHMAP_DEFAULT_MAX_LOAD 75
+#define HASHMAP_REHASH_STEP 16
+
+/* How many keys the batch calls hash and prefetch ahead of probing. */
+#define HASHMAP_BATCH 16
+
+/* When the load passes max_load percent the map doubles. The previous table
+ * is kept in old_records and drained HASHMAP_REHASH_STEP slots at a time by
+ * later inserts and deletes; lookups check both tables meanwhile. Deletes
+ * shift entries back instead of leaving tombstones, so DELETED records only
+ * appear in old_records. */
 typedef struct
 {
     HashmapRecord* records;
@@ -258,14 +615,82 @@ typedef struct
     bool (*equals_fn)(const void*, const void*);
     size_t capacity;
     size_t length;
+    Allocator* allocator;
+    size_t max_load;
+    HashmapRecord* old_records;
+    size_t old_capacity;
+    size_t migrated;
+    uint64_t seed;
 } Hashmap;
 
+/* Hashmap split into shards chosen by the top bits of the hash, each behind
+ * its own reader-writer spin lock. Lookups only take the shard's lock in
+ * shared mode, so readers wait only for a writer on the same shard. */
+#define CONCURRENT_HASHMAP_SHARD_BITS 6
+#define CONCURRENT_HASHMAP_SHARD_COUNT (1 << CONCURRENT_HASHMAP_SHARD_BITS)
+
+/* Aligned so the locks of neighbouring shards do not share a cache line. */
+typedef struct CCORE_CACHE_ALIGN
+{
+    int lock;
+    Hashmap map;
+} HashmapShard;
+
+typedef struct
+{
+    HashmapShard shards[CONCURRENT_HASHMAP_SHARD_COUNT];
+    Allocator allocator;
+    Allocator* parent;
+    int allocator_lock;
+} ConcurrentHashmap;
+
+/* Swiss-table style map specialised for ByteString keys. Every slot has a
+ * control byte holding 7 bits of the key's hash, or EMPTY/DELETED, and
+ * lookups compare BYTE_STRING_MAP_GROUP control bytes at once before any
+ * key is touched. Keys are stored by value but their bytes are not
+ * copied. */
+#define BYTE_STRING_MAP_GROUP 16
+
+typedef struct
+{
+    ByteString key;
+    void* value;
+} ByteStringMapSlot;
+
+typedef struct
+{
+    ByteStringMapSlot* slots;
+    u8* control;
+    size_t capacity;
+    size_t length;
+    size_t tombstones;
+    Allocator* allocator;
+    uint64_t seed;
+} ByteStringMap;
+
 uint64_t
 cstr_hash(const char* key);
 
+/* FNV-1a, one byte per step. Stable across versions and seeds, so it is
+ * the one to use for hashes that are stored. */
 uint64_t
 bytes_hash(const u8* key, size_t length);
 
+/* wyhash-style hash, up to 48 bytes per step. ByteString maps and the
+ * Interner use it unless CCORE_BYTE_STRING_HASH_FNV is defined, with the
+ * global seed as it was when the map was initialised, so changing the seed
+ * only affects maps initialised afterwards. Set a random seed at startup to
+ * resist hash flooding. Typed maps hash with their own hash_fn and never
+ * read the seed. */
+uint64_t
+bytes_hash_seeded(const u8* key, size_t length, uint64_t seed);
+
+void
+hash_seed_set(uint64_t seed);
+
+uint64_t
+hash_seed_get(void);
+
 void
 hashmap_init(Hashmap* hashmap,
              uint64_t (*hash_fn)(const void*),
@@ -273,6 +698,9 @@ hashmap_init(Hashmap* hashmap,
              size_t capacity,
              Allocator* allocator);
 
+void
+hashmap_destroy(Hashmap* hashmap);
+
 void
 hashmap_byte_string_init(Hashmap* hashmap,
                          size_t capacity,
@@ -293,5 +721,299 @@ hashmap_byte_string_get(Hashmap* hashmap, ByteString key);
 void*
 hashmap_delete(Hashmap* hashmap, void* key);
 
+/* Returns nonzero if the table could not be allocated. The map is then
+ * empty, and the first insert tries to allocate it again. */
+int
+byte_string_map_init(ByteStringMap* map, size_t capacity, Allocator* allocator);
+
+void
+byte_string_map_destroy(ByteStringMap* map);
+
+int
+byte_string_map_insert(ByteStringMap* map, ByteString key, void* value);
+
+void*
+byte_string_map_get(ByteStringMap* map, ByteString key);
+
+void*
+byte_string_map_delete(ByteStringMap* map, ByteString key);
+
+size_t
+byte_string_map_len(ByteStringMap* map);
+
+/* Look up or insert count keys at once. All keys of a batch are hashed and
+ * their home slots prefetched before any is probed. get stores the value of
+ * keys[i], or NULL, in values[i]; insert adds keys[i] -> values[i] and
+ * returns how many keys were new. */
+void
+hashmap_get_batch(Hashmap* hashmap, void** keys, void** values, size_t count);
+
+size_t
+hashmap_insert_batch(Hashmap* hashmap,
+                     void** keys,
+                     void** values,
+                     size_t count);
+
 size_t
 hashmap_len(Hashmap* hashmap);
+
+void
+concurrent_hashmap_init(ConcurrentHashmap* map,
+                        uint64_t (*hash_fn)(const void*),
+                        bool (*equals_fn)(const void*, const void*),
+                        size_t capacity,
+                        Allocator* allocator);
+
+void
+concurrent_hashmap_destroy(ConcurrentHashmap* map);
+
+int
+concurrent_hashmap_insert(ConcurrentHashmap* map, void* key, void* value);
+
+void*
+concurrent_hashmap_get(ConcurrentHashmap* map, void* key);
+
+void*
+concurrent_hashmap_delete(ConcurrentHashmap* map, void* key);
+
+size_t
+concurrent_hashmap_len(ConcurrentHashmap* map);
+
+/* Maps strings to dense u32 ids, so interned strings compare by id. The
+ * bytes of every string are stored back to back in one VArena and the id
+ * entries in another, so a lookup by id is a single index. The hash index
+ * is an open-addressed table of ids allocated from the given Allocator. */
+#define INTERNER_MIN_CAPACITY 64
+#define INTERNER_INVALID_ID UINT32_MAX
+
+/* 16 bytes on every target, a multiple of DEFAULT_ALIGNMENT. */
+typedef struct
+{
+    uint64_t offset;
+    u32 length;
+    u32 hash;
+} InternEntry;
+
+typedef struct
+{
+    VArena bytes;
+    VArena entries;
+    u32* table;
+    size_t capacity;
+    u32 count;
+    Allocator* allocator;
+    uint64_t seed;
+} Interner;
+
+/* reserve is the address space reserved for the string bytes, and again for
+ * the id entries. Memory is committed as strings are added. */
+int
+interner_init(Interner* interner, size_t reserve, Allocator* allocator);
+
+void
+interner_destroy(Interner* interner);
+
+/* Returns the id of string, copying it in if it is new. Returns
+ * INTERNER_INVALID_ID if the string is 4 GiB or longer, or if it does not
+ * fit in what is left of the reservation. */
+u32
+interner_intern(Interner* interner, ByteString string);
+
+bool
+interner_find(Interner* interner, ByteString string, u32* id);
+
+/* The returned string points into the interner and stays valid until it is
+ * destroyed. */
+ByteString
+interner_lookup(Interner* interner, u32 id);
+
+u32
+interner_count(Interner* interner);
+
+#ifdef __GNUC__
+#define CCORE_INLINE static __inline__
+#else
+#define CCORE_INLINE static
+#endif
+
+/* 64-bit finaliser from MurmurHash3, for integer keys of typed maps. */
+CCORE_INLINE uint64_t
+u64_hash(u64 key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+#define u64_equal(a, b) ((a) == (b))
+
+/* Stamps out a map type `name` with keys and values stored inline, for
+ * example hashmap_define(U64Map, u64, u64, u64_hash, u64_equal). hash_fn
+ * and equals_fn may be functions or macros; they are called directly so the
+ * compiler can inline them. Probing is linear with backward-shift deletion
+ * and a one byte occupancy array next to the entries, and the map doubles
+ * past 3/4 load. The generated functions are name_init (false if the
+ * first table could not be allocated), name_destroy, name_clear,
+ * name_insert, name_get (a pointer to the value or NULL), name_delete and
+ * name_len. */
+#define hashmap_define(name, key_type, value_type, hash_fn, equals_fn)         \
+    typedef struct                                                             \
+    {                                                                          \
+        key_type key;                                                          \
+        value_type value;                                                      \
+    } name##Entry;                                                             \
+                                                                               \
+    typedef struct                                                             \
+    {                                                                          \
+        name##Entry* entries;                                                  \
+        u8* filled;                                                            \
+        size_t capacity;                                                       \
+        size_t length;                                                         \
+        Allocator* allocator;                                                  \
+    } name;                                                                    \
+                                                                               \
+    CCORE_INLINE bool name##_alloc_(name* map, size_t capacity)                \
+    {                                                                          \
+        size_t size  = (sizeof(name##Entry) + 1) * capacity;                   \
+        map->entries = map->allocator->alloc(size, map->allocator->context);   \
+        if (map->entries == NULL) {                                            \
+            return false;                                                      \
+        }                                                                      \
+        map->filled   = (u8*)(map->entries + capacity);                        \
+        map->capacity = capacity;                                              \
+        map->length   = 0;                                                     \
+        memset(map->filled, 0, capacity);                                      \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE void name##_free_(name* map)                                  \
+    {                                                                          \
+        map->allocator->free(map->entries,                                     \
+                             (sizeof(name##Entry) + 1) * map->capacity,        \
+                             map->allocator->context);                         \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE bool name##_init(                                             \
+      name* map, size_t capacity, Allocator* allocator)                        \
+    {                                                                          \
+        size_t rounded = 8;                                                    \
+        while (rounded < capacity) {                                           \
+            rounded <<= 1;                                                     \
+        }                                                                      \
+        map->allocator = allocator;                                            \
+        if (!name##_alloc_(map, rounded)) {                                    \
+            map->entries  = NULL;                                              \
+            map->filled   = NULL;                                              \
+            map->capacity = 0;                                                 \
+            map->length   = 0;                                                 \
+            return false;                                                      \
+        }                                                                      \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE void name##_destroy(name* map)                                \
+    {                                                                          \
+        name##_free_(map);                                                     \
+        map->entries  = NULL;                                                  \
+        map->filled   = NULL;                                                  \
+        map->capacity = 0;                                                     \
+        map->length   = 0;                                                     \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE void name##_clear(name* map)                                  \
+    {                                                                          \
+        memset(map->filled, 0, map->capacity);                                 \
+        map->length = 0;                                                       \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE size_t name##_slot_(const name* map, key_type key)            \
+    {                                                                          \
+        size_t mask = map->capacity - 1;                                       \
+        size_t idx  = (size_t)(hash_fn(key)) & mask;                           \
+        while (map->filled[idx] && !(equals_fn(map->entries[idx].key, key))) { \
+            idx = (idx + 1) & mask;                                            \
+        }                                                                      \
+        return idx;                                                            \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE value_type* name##_get(name* map, key_type key)               \
+    {                                                                          \
+        size_t idx = name##_slot_(map, key);                                   \
+        return map->filled[idx] ? &map->entries[idx].value : NULL;             \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE bool name##_grow_(name* map)                                  \
+    {                                                                          \
+        name old = *map;                                                       \
+        size_t i;                                                              \
+        if (!name##_alloc_(map, old.capacity * 2)) {                           \
+            *map = old;                                                        \
+            return false;                                                      \
+        }                                                                      \
+        for (i = 0; i < old.capacity; i++) {                                   \
+            if (old.filled[i]) {                                               \
+                size_t idx        = name##_slot_(map, old.entries[i].key);     \
+                map->filled[idx]  = 1;                                         \
+                map->entries[idx] = old.entries[i];                            \
+            }                                                                  \
+        }                                                                      \
+        map->length = old.length;                                              \
+        name##_free_(&old);                                                    \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE int name##_insert(name* map, key_type key, value_type value)  \
+    {                                                                          \
+        size_t idx = name##_slot_(map, key);                                   \
+        if (map->filled[idx]) {                                                \
+            return 1;                                                          \
+        }                                                                      \
+        if ((map->length + 1) * 4 > map->capacity * 3) {                       \
+            if (!name##_grow_(map)) {                                          \
+                return 1;                                                      \
+            }                                                                  \
+            idx = name##_slot_(map, key);                                      \
+        }                                                                      \
+        map->filled[idx]        = 1;                                           \
+        map->entries[idx].key   = key;                                         \
+        map->entries[idx].value = value;                                       \
+        map->length++;                                                         \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE bool name##_delete(                                           \
+      name* map, key_type key, value_type* value)                              \
+    {                                                                          \
+        size_t mask = map->capacity - 1;                                       \
+        size_t gap  = name##_slot_(map, key);                                  \
+        size_t idx  = gap;                                                     \
+        if (!map->filled[gap]) {                                               \
+            return false;                                                      \
+        }                                                                      \
+        if (value != NULL) {                                                   \
+            *value = map->entries[gap].value;                                  \
+        }                                                                      \
+        for (;;) {                                                             \
+            size_t home;                                                       \
+            idx = (idx + 1) & mask;                                            \
+            if (!map->filled[idx]) {                                           \
+                break;                                                         \
+            }                                                                  \
+            home = (size_t)(hash_fn(map->entries[idx].key)) & mask;            \
+            if (((idx - home) & mask) >= ((idx - gap) & mask)) {               \
+                map->entries[gap] = map->entries[idx];                         \
+                gap               = idx;                                       \
+            }                                                                  \
+        }                                                                      \
+        map->filled[gap] = 0;                                                  \
+        map->length--;                                                         \
+        return true;                                                           \
+    }                                                                          \
+                                                                               \
+    CCORE_INLINE size_t name##_len(const name* map)                            \
+    {                                                                          \
+        return map->length;                                                    \
+    }
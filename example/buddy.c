@@ -126,6 +126,26 @@ example_buddy_realloc_larger()
     free(data);
 }
 
+void
+example_buddy_bitmap()
+{
+    printf("----BUDDY BITMAP METADATA----\n");
+    void* data     = malloc(SIZE);
+    void* metadata = malloc(buddy_allocator_metadata_size(SIZE, 64));
+
+    BuddyAllocator buddy = { 0 };
+    buddy_allocator_init_bitmap(&buddy, data, SIZE, 64, metadata);
+
+    int count = 0;
+    while (buddy_allocator_alloc(&buddy, 64) != NULL) {
+        count++;
+    }
+    printf("Fit %d 64-byte objects in %d bytes.\n", count, (int)(SIZE));
+
+    free(metadata);
+    free(data);
+}
+
 int
 main(void)
 {
@@ -134,5 +154,6 @@ main(void)
     test_buddy_realloc_exhaustion();
     test_buddy_boundary_cases();
     test_buddy_fragmentation_stress();
+    example_buddy_bitmap();
     return 0;
 }
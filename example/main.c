@@ -78,6 +78,63 @@ example_arena(void)
     free(base);
 }
 
+void
+example_arena_chained(void)
+{
+    printf("----CHAINED ARENA----\n");
+    u8 first_block[256];
+    VArena varena = { 0 };
+    varena_init(&varena, 1 << 20);
+    Allocator parent = varena_allocator(&varena);
+    Arena arena = { 0 };
+    arena_init_chained(&arena, first_block, sizeof(first_block), &parent);
+
+    int request = 0;
+    for (request = 0; request < 3; request++) {
+        size_t i = 0;
+        for (i = 0; i < 64; i++) {
+            int* value = arena_push_array(&arena, int, 8);
+            assert(value != NULL);
+            value[7] = (int)i;
+        }
+        printf("Request %d ended in a block of %zu bytes\n",
+               request,
+               arena.size);
+        arena_clear(&arena);
+    }
+
+    arena_destroy(&arena);
+    varena_destroy(&varena);
+}
+
+static char*
+format_pair(VArena* out, int key, int value)
+{
+    /* The caller's arena may itself be a scratch arena, so exclude it. */
+    ScratchArena scratch = scratch_begin(&out, 1);
+    char* temp = varena_push(scratch.arena, 64);
+    int length = sprintf(temp, "%d=%d", key, value);
+    char* result = varena_push(out, length + 1);
+    memcpy(result, temp, length + 1);
+    scratch_end(scratch);
+    return result;
+}
+
+void
+example_scratch(void)
+{
+    printf("----SCRATCH ARENAS----\n");
+    ScratchArena scratch = scratch_begin(NULL, 0);
+    size_t before = varena_mark(scratch.arena);
+    char* pair = format_pair(scratch.arena, 4, 16);
+    printf("Formatted \"%s\" using %zu bytes of the outer scratch arena\n",
+           pair,
+           scratch.arena->used - before);
+    scratch_end(scratch);
+    assert(scratch.arena->used == before);
+    scratch_release();
+}
+
 void
 example_hashmap_byte_string(void)
 {
@@ -112,6 +169,69 @@ example_hashmap_byte_string(void)
     varena_destroy(&varena);
 }
 
+hashmap_define(U64Map, u64, u64, u64_hash, u64_equal)
+
+void
+example_hashmap_typed(void)
+{
+    printf("----HASHMAP TYPED----\n");
+    VArena varena = { 0 };
+    varena_init(&varena, 1 << 20);
+    Allocator alloc = varena_allocator(&varena);
+    U64Map squares;
+    u64 i = 0;
+    u64 removed = 0;
+    if (!U64Map_init(&squares, 16, &alloc)) {
+        fprintf(stderr, "Error initializing U64Map.\n");
+        varena_destroy(&varena);
+        return;
+    }
+    for (i = 0; i < 1000; i++) {
+        U64Map_insert(&squares, i, i * i);
+    }
+    assert(U64Map_insert(&squares, 7, 0) == 1);
+    for (i = 0; i < 1000; i += 2) {
+        assert(U64Map_delete(&squares, i, &removed));
+        assert(removed == i * i);
+    }
+    for (i = 0; i < 1000; i++) {
+        u64* value = U64Map_get(&squares, i);
+        assert((value != NULL) == (i % 2 == 1));
+        assert(value == NULL || *value == i * i);
+    }
+    printf("U64Map holds %zu entries in %zu slots\n",
+           U64Map_len(&squares),
+           squares.capacity);
+    U64Map_destroy(&squares);
+    varena_destroy(&varena);
+}
+
+void
+example_interner(void)
+{
+    printf("----INTERNER----\n");
+    VArena varena = { 0 };
+    varena_init(&varena, 1 << 16);
+    Allocator alloc = varena_allocator(&varena);
+    Interner interner;
+    interner_init(&interner, 1 << 20, &alloc);
+
+    u32 first  = interner_intern(&interner, byte_string_from_cstr("alpha"));
+    u32 second = interner_intern(&interner, byte_string_from_cstr("beta"));
+    u32 again  = interner_intern(&interner, byte_string_from_cstr("alpha"));
+    assert(first == again && first != second);
+
+    ByteString name = interner_lookup(&interner, second);
+    printf("Interned %u strings, id %u is \"%.*s\"\n",
+           interner_count(&interner),
+           second,
+           (int)name.length,
+           name.ptr);
+
+    interner_destroy(&interner);
+    varena_destroy(&varena);
+}
+
 void
 example_array_copy(void)
 {
@@ -168,8 +288,12 @@ int
 main(void)
 {
     example_arena();
+    example_arena_chained();
+    example_scratch();
     example_array_assign();
     example_array_copy();
     example_hashmap_byte_string();
+    example_hashmap_typed();
+    example_interner();
     return 0;
 }
@@ -66,6 +66,65 @@ main(void)
         count++;
     }
 
+    printf("\n--- Test 4: Growable Pool ---\n");
+    Pool growable = { 0 };
+    pool_init_virtual(&growable, 1ULL << 32, sizeof(Vec3), DEFAULT_ALIGNMENT);
+    void** chunks = malloc(sizeof(void*) * 100000);
+    void* first   = pool_allocate(&growable);
+    for (i = 0; i < 100000; i++) {
+        chunks[i] = pool_allocate(&growable);
+    }
+    printf("Committed %zu bytes for 100001 chunks, first chunk still at %p\n",
+           growable.capacity,
+           first);
+
+    /* Freeing the low half and trimming releases slabs below the bump
+     * pointer; allocating the same amount again must reuse them. */
+    size_t committed = growable.capacity;
+    for (i = 0; i < 50000; i++) {
+        pool_free(&growable, chunks[i]);
+    }
+    size_t trimmed = pool_trim(&growable);
+    for (i = 0; i < 50000; i++) {
+        chunks[i] = pool_allocate(&growable);
+    }
+    assert(growable.capacity == committed && growable.decommitted == 0);
+    printf("SUCCESS: Reused %zu trimmed bytes without growing past %zu\n",
+           trimmed,
+           growable.capacity);
+    free(chunks);
+    pool_free_all(&growable);
+    printf("Released %zu bytes after freeing everything\n",
+           pool_trim(&growable));
+
+    printf("\n--- Test 5: Batched Alloc/Free ---\n");
+    void* batch[64];
+    growable.zero_chunks = true;
+    size_t taken         = pool_allocate_n(&growable, batch, 64);
+    printf("Took %zu zeroed chunks in one call\n", taken);
+    pool_free_n(&growable, batch, taken);
+    if (pool_allocate_uninit(&growable) == batch[0]) {
+        printf("SUCCESS: Batch free pushed the chain in order.\n");
+    }
+    pool_destroy(&growable);
+
+    printf("\n--- Test 6: Size-Class Slab Allocator ---\n");
+    SlabAllocator slab;
+    slab_allocator_init(&slab, 1ULL << 30, NULL);
+    Allocator slab_alloc = slab_allocator(&slab);
+    int* numbers         = array(int, 1, &slab_alloc);
+    for (i = 0; i < 200; i++) {
+        array_append(numbers, i);
+    }
+    printf("numbers[199]: %d, capacity %zu\n",
+           numbers[199],
+           array_header(numbers)->capacity);
+    char* small = make(char, 24, &slab_alloc);
+    printf("24-byte request served from the %zu-byte class\n",
+           slab.pools[slab.class_of[(24 + 15) >> 4]].chunk_size);
+    slab_alloc.free(small, 24, slab_alloc.context);
+    slab_allocator_destroy(&slab);
+
     free(base);
     return 0;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -58,6 +60,86 @@ vmem_decommit(void* ptr, size_t size)
 #endif
 }
 
+/* Reserves size bytes starting at a multiple of alignment, by reserving
+ * extra and unmapping the misaligned ends. Windows cannot release part of a
+ * reservation, so there it falls back to an ordinary one. */
+static void*
+vmem_reserve_aligned(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    (void)alignment;
+    return vmem_reserve(size);
+#else
+    uint8_t* ptr = vmem_reserve(size + alignment);
+    uint8_t* aligned;
+
+    if (ptr == NULL) {
+        return NULL;
+    }
+    aligned = (uint8_t*)(((uintptr_t)ptr + alignment - 1) & ~(alignment - 1));
+    if (aligned != ptr) {
+        munmap(ptr, aligned - ptr);
+    }
+    munmap(aligned + size, ptr + alignment - aligned);
+    return aligned;
+#endif
+}
+
+/* Reserves from the explicit huge page pool. Unlike vmem_reserve the whole
+ * size is taken from the pool up front, since touching a huge page the pool
+ * cannot supply kills the process. Returns NULL when it is unsupported or
+ * the pool is too small. */
+static void*
+vmem_reserve_hugetlb(size_t size)
+{
+#if defined(MAP_HUGETLB)
+    void* ptr = mmap(NULL,
+                     size,
+                     PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                     -1,
+                     0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+#else
+    (void)size;
+    return NULL;
+#endif
+}
+
+/* Asks for transparent huge pages in the range. Only a hint. */
+static int
+vmem_advise_huge(void* ptr, size_t size)
+{
+#if defined(MADV_HUGEPAGE)
+    return madvise(ptr, size, MADV_HUGEPAGE) == 0;
+#else
+    (void)ptr;
+    (void)size;
+    return 0;
+#endif
+}
+
+/* Faults in a committed range now, in one call where the kernel supports
+ * it, so that first touches later do not fault page by page. */
+static void
+vmem_prefault(void* ptr, size_t size, size_t page_size)
+{
+    volatile uint8_t* page = ptr;
+    size_t offset;
+
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+#if defined(MADV_WILLNEED)
+    madvise(ptr, size, MADV_WILLNEED);
+#endif
+    for (offset = 0; offset < size; offset += page_size) {
+        page[offset] = page[offset];
+    }
+}
+
 static void
 vmem_release(void* ptr, size_t size)
 {